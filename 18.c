@@ -1,904 +1,7425 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-// #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #define MAX_AUTO 512
-// AVL
+
+// Path planners, picked at build time with -DPATH_PLANNER=<planner>
+#define PLANNER_DIJKSTRA 0
+#define PLANNER_SWEEP 1
+#define PLANNER_FRONTIER 2
+#ifndef PATH_PLANNER
+#define PATH_PLANNER PLANNER_SWEEP
+#endif
+
+// Station index engines, picked at build time with -DSTATION_INDEX=<engine>
+#define INDEX_AVL 0
+#define INDEX_BPLUS 1
+#ifndef STATION_INDEX
+#define STATION_INDEX INDEX_AVL
+#endif
+
+#if PATH_PLANNER == PLANNER_FRONTIER && STATION_INDEX != INDEX_AVL
+#error "the frontier planner needs the reach bounds of the AVL station index"
+#endif
+
+// Compact storage, -DCOMPACT_STATIONS=1: the AVL nodes live in one pool and
+// link to each other by 32-bit pool index, and a node keeps only what the
+// searches read. The car pool, the cold half, sits in a parallel array at the
+// same index, which is also the station id of the planner side arrays, and
+// keeps its counts in 16 bits. Both arrays are reserved up front for
+// COMPACT_MAX_STATIONS with MAP_NORESERVE, so nodes never move and only the
+// pages of stations that existed are used.
+#ifndef COMPACT_STATIONS
+#define COMPACT_STATIONS 0
+#endif
+#ifndef COMPACT_MAX_STATIONS
+#define COMPACT_MAX_STATIONS (1 << 27)
+#endif
+
+#if COMPACT_STATIONS && STATION_INDEX != INDEX_AVL
+#error "compact stations are nodes of the AVL station index"
+#endif
+
+// Search counters reported by --stats. They are plain per-thread increments,
+// the threads that exit add theirs to mergedCounters; -DCOMMAND_STATS=0
+// compiles them and the latency timing out.
+#ifndef COMMAND_STATS
+#define COMMAND_STATS 1
+#endif
+
+// Development tools, -DDEV_TOOLS=1 builds them into the binary: the --client
+// load generator for --serve, the --stress check of the --concurrent views
+// and the --bench-kernels microbenchmarks. A plain build only runs the
+// commands.
+#ifndef DEV_TOOLS
+#define DEV_TOOLS 0
+#endif
+
+typedef struct searchCounters {
+    long long stationsVisited;  // sweep entries, Dijkstra expansions, frontier descent steps
+    long long heapPushes;
+    long long heapDecreases;
+    long long heapPops;
+    long long rotations;
+    long long successorClimbs;  // parent steps taken by getSuccessor
+    long long predecessorClimbs;
+} searchCounters;
+
+#if COMMAND_STATS
+static __thread searchCounters threadCounters;
+static searchCounters mergedCounters;
+#define COUNT(counter) (threadCounters.counter++)
+#define COUNT_BY(counter, amount) (threadCounters.counter += (amount))
+#else
+#define COUNT(counter) ((void)0)
+#define COUNT_BY(counter, amount) ((void)0)
+#endif
+
+static inline long long nowNanos(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// A car pool is a multiset of autonomies, kept as value/count pairs sorted by
+// autonomy: the biggest one is always the last entry
+typedef struct carEntry {
+    int autonomy;
+    int count;
+} carEntry;
+
+// Pool sizes never go over MAX_AUTO, the compact layout keeps them in 16 bits
+#if COMPACT_STATIONS
+typedef unsigned short carCount;
+#if MAX_AUTO > 65535
+#error "MAX_AUTO does not fit the compact car pools"
+#endif
+#else
+typedef int carCount;
+#endif
 
 typedef struct carList {
-    int capacity;
-    int numCars;
-    int *cars;
+    carCount capacity;   // allocated entries
+    carCount numValues;  // distinct autonomies
+    carCount numCars;    // cars in the pool, duplicates included
+    carEntry *cars;
 } carList;
 
-// stations are organized in an AVL
+#if COMPACT_STATIONS
+typedef uint32_t stationLink;  // pool index + 1, 0 for no station
+#else
+typedef struct station *stationLink;
+#endif
+
+// stations are organized in an AVL, or in the leaves of a B+-tree
 typedef struct station {
     int distance;
+#if !COMPACT_STATIONS
     carList *carPool;
-    struct station *left;
-    struct station *right;
-    struct station *parent;
+#endif
+#if STATION_INDEX == INDEX_BPLUS
+    struct bplusLeaf *leaf;
+    int slot;
+#else
+    stationLink left;
+    stationLink right;
+    stationLink parent;
+#endif
     int maxAutonomy;
+#if !COMPACT_STATIONS
+    int id;  // dense index into the planner side arrays
+#endif
 
-    bool visited;
-    int minWeight;
-    int steps;
-    struct station *pathPrevious;
-
+#if STATION_INDEX == INDEX_AVL
     int height;
+#endif
+#if PATH_PLANNER == PLANNER_FRONTIER
+    // over the subtree: farthest distance reached going forward and nearest
+    // one reached going backward
+    int reachRight;
+    int reachLeft;
+#endif
 } station;
 
-carList *createCarPool() {
-    carList *newCarPool = (carList *)malloc(sizeof(carList));
-    newCarPool->capacity = MAX_AUTO;
-    newCarPool->numCars = 0;
-    newCarPool->cars = (int *)malloc(newCarPool->capacity * sizeof(int));
+#if COMPACT_STATIONS
+static station *stationPool;
+static carList *carPools;
 
-    for (int i = 0; i < newCarPool->capacity; i++) {
-        newCarPool->cars[i] = 0;
-    }
+static inline station *linkedStation(stationLink link) {
+    return link ? &stationPool[link - 1] : NULL;
+}
 
-    return newCarPool;
+static inline stationLink stationLinkOf(station *node) {
+    return node ? (stationLink)(node - stationPool) + 1 : 0;
 }
 
-void freeCarPool(carList **carPoolToRemove) {
-    if (*carPoolToRemove) {
-        free((*carPoolToRemove)->cars);
-        free(*carPoolToRemove);
-        *carPoolToRemove = NULL;
-    }
+static inline int stationId(station *node) {
+    return (int)(node - stationPool);
 }
 
-void printTreeDetails(station *root) {
-    if (root == NULL) {
-        return;
-    }
-    printTreeDetails(root->left);
+static inline carList *stationCars(station *node) {
+    return &carPools[node - stationPool];
+}
+#else
+static inline station *linkedStation(stationLink link) {
+    return link;
+}
 
-    printf("Distance: %d\n", root->distance);
-    if (root->parent)
-        printf("Parent: %d\n", root->parent->distance);
-    else
-        printf("Parent: NULL\n");
+static inline stationLink stationLinkOf(station *node) {
+    return node;
+}
 
-    if (root->left)
-        printf("Left: %d\n", root->left->distance);
-    else
-        printf("Left: NULL\n");
+static inline int stationId(station *node) {
+    return node->id;
+}
 
-    if (root->right)
-        printf("Right: %d\n", root->right->distance);
-    else
-        printf("Right: NULL\n");
-    // if (root->deleted)
-    //     printf("DELETED\n");
-    // printf("maxAut: %d\n", root->maxAutonomy);
-    // printf("weight: %d\n", root->minWeight);
-    // printf("steps: %d\n", root->steps);
-    // if (root->pathPrevious)
-    //     printf("previous: %d\n", root->pathPrevious->distance);
-    // else
-    //     printf("previous: \n");
-    // printCars(root->cars);
-    // printf("Reachable Nodes: ");
-    // printReachableNodes(root->reachable);
-    // printf("Reachable By Nodes: ");
-    // printReachableNodes(root->reachableBy);
-    printf("\n");
+static inline carList *stationCars(station *node) {
+    return node->carPool;
+}
+#endif
 
-    printTreeDetails(root->right);
+#if STATION_INDEX == INDEX_AVL
+static inline station *leftOf(station *node) {
+    return linkedStation(node->left);
 }
 
-void freeTree(station **root) {
-    if (*root != NULL) {
-        freeTree(&(*root)->left);
-        freeTree(&(*root)->right);
-        freeCarPool(&(*root)->carPool);
-        // freeCarList(&(*root)->cars);
-        // freeReachList(&(*root)->reachable);
-        // freeReachList(&(*root)->reachableBy);
-        free(*root);
-    }
+static inline station *rightOf(station *node) {
+    return linkedStation(node->right);
 }
 
-void resetVisitedStations(station *root) {
-    if (root != NULL) {
-        resetVisitedStations(root->left);
-        root->visited = false;
-        root->minWeight = INT_MAX;
-        root->steps = INT_MAX;
-        root->pathPrevious = NULL;
-        // root->alreadyInQueue = false;
-        // freeReachList(&root->reachable);
-        // root->reachable = NULL;
-        resetVisitedStations(root->right);
-    }
+static inline station *parentOf(station *node) {
+    return linkedStation(node->parent);
 }
 
-station *findStation(station *root, int distance) {
-    while (root != NULL) {
-        if (root->distance == distance) {
-            return root;
-        } else if (distance < root->distance) {
-            root = root->left;
-        } else {
-            root = root->right;
-        }
-    }
-    return NULL;
+static inline void setLeft(station *node, station *child) {
+    node->left = stationLinkOf(child);
 }
 
-// Helper function to get the height of a node
-int getHeight(station *node) {
-    if (node == NULL) {
-        return 0;
-    }
-    return node->height;
+static inline void setRight(station *node, station *child) {
+    node->right = stationLinkOf(child);
 }
 
-// Helper function to update the height of a node
-void updateHeight(station *node) {
-    if (node == NULL) {
-        return;
-    }
-    int leftHeight = getHeight(node->left);
-    int rightHeight = getHeight(node->right);
-    node->height = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+static inline void setParent(station *node, station *parent) {
+    node->parent = stationLinkOf(parent);
+}
+#endif
+
+// Hash table from distance to station kept next to the ordered index, so
+// point lookups skip the descent; -DSTATION_TABLE=0 turns it off
+#ifndef STATION_TABLE
+#define STATION_TABLE 1
+#endif
+
+// Open addressing with linear probing, at most half full. Distances and
+// stations are separate arrays so probing only touches the distances.
+typedef struct stationTable {
+    int *distances;
+    stationLink *nodes;  // NULL marks a free slot
+    int capacity;     // power of two, 0 until the first insert
+    int count;
+    int shift;        // 32 - log2(capacity)
+} stationTable;
+
+#if STATION_INDEX == INDEX_BPLUS
+// B+-tree: leaves hold the distances and maxAutonomy of their stations in
+// contiguous arrays and are chained in order, inner nodes only hold keys
+#ifndef BPLUS_ORDER
+#define BPLUS_ORDER 32
+#endif
+#define BPLUS_MAX_HEIGHT 32
+
+typedef struct bplusLeaf {
+    int count;
+    int distances[BPLUS_ORDER];
+    int maxAutonomies[BPLUS_ORDER];
+    station *stations[BPLUS_ORDER];
+    struct bplusLeaf *previous;
+    struct bplusLeaf *next;
+} bplusLeaf;
+
+// every distance under children[i] is >= keys[i] and < keys[i + 1]
+typedef struct bplusInner {
+    int count;
+    int keys[BPLUS_ORDER];
+    void *children[BPLUS_ORDER];
+} bplusInner;
+
+typedef struct stationIndex {
+    void *root;
+    int height;  // inner levels above the leaves
+    bplusLeaf *first;
+    struct pathCache *cache;  // answers to invalidate on changes, may be NULL
+    struct standingRoutes *routes;
+    struct reachIndex *reach;  // hop count tables, built on first use
+    struct readIndex *sorted;  // flat copy for pianifica-percorso, built between changes
+    struct viewDomain *views;  // snapshots for the --concurrent readers, may be NULL
+    struct loadedSnapshot *loaded;  // --load stations not built yet, NULL once they are
+    stationTable table;
+} stationIndex;
+#else
+typedef struct stationIndex {
+    station *root;
+    struct pathCache *cache;  // answers to invalidate on changes, may be NULL
+    struct standingRoutes *routes;
+    struct reachIndex *reach;  // hop count tables, built on first use
+    struct readIndex *sorted;  // flat copy for pianifica-percorso, built between changes
+    struct viewDomain *views;  // snapshots for the --concurrent readers, may be NULL
+    struct loadedSnapshot *loaded;  // --load stations not built yet, NULL once they are
+    stationTable table;
+} stationIndex;
+#endif
+
+// Single producer single consumer ring of pointers, used to pass buffers
+// between the stages of the --pipeline mode. Each side only writes its own
+// index; a side that finds the ring empty (or full) spins for a while and
+// then sleeps on the condition variable, and is woken by the other side.
+#define RING_CAPACITY 16
+#define RING_SPINS 256
+
+typedef struct spscRing {
+    void *slots[RING_CAPACITY];
+    unsigned int head;  // next slot to pop, written by the consumer
+    unsigned int tail;  // next slot to push, written by the producer
+    int sleepers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} spscRing;
+
+void initRing(spscRing *ring) {
+    ring->head = 0;
+    ring->tail = 0;
+    ring->sleepers = 0;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->wake, NULL);
 }
 
-// Helper function to perform a right rotation
-station *rotateRight(station *y) {
-    station *x = y->left;
-    station *T2 = x->right;
+void destroyRing(spscRing *ring) {
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->wake);
+}
 
-    x->right = y;
-    y->left = T2;
+static inline bool ringReady(spscRing *ring, bool toPush) {
+    unsigned int used = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) - __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+    return toPush ? used < RING_CAPACITY : used > 0;
+}
 
-    // Update parent pointers
-    x->parent = y->parent;
-    y->parent = x;
-    if (T2 != NULL) {
-        T2->parent = y;
+static void waitRing(spscRing *ring, bool toPush) {
+    for (int spin = 0; spin < RING_SPINS; spin++) {
+        if (ringReady(ring, toPush)) {
+            return;
+        }
     }
+    // announcing the sleeper before the last check pairs with the other side
+    // moving its index before looking for sleepers, so no wakeup is lost
+    pthread_mutex_lock(&ring->lock);
+    __atomic_add_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+    while (!ringReady(ring, toPush)) {
+        pthread_cond_wait(&ring->wake, &ring->lock);
+    }
+    __atomic_sub_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&ring->lock);
+}
 
-    updateHeight(y);
-    updateHeight(x);
+static void wakeRing(spscRing *ring) {
+    if (__atomic_load_n(&ring->sleepers, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&ring->lock);
+        pthread_cond_broadcast(&ring->wake);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
 
-    return x;
+void ringPush(spscRing *ring, void *item) {
+    waitRing(ring, true);
+    ring->slots[ring->tail % RING_CAPACITY] = item;
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_SEQ_CST);
+    wakeRing(ring);
 }
 
-// Helper function to perform a left rotation
-station *rotateLeft(station *x) {
-    station *y = x->right;
-    station *T2 = y->left;
+void *ringPop(spscRing *ring) {
+    waitRing(ring, false);
+    void *item = ring->slots[ring->head % RING_CAPACITY];
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_SEQ_CST);
+    wakeRing(ring);
+    return item;
+}
 
-    y->left = x;
-    x->right = T2;
+// Output layer: every result is appended to a growable buffer that is handed
+// to write() in large chunks instead of going through printf
+#define OUTPUT_FLUSH_THRESHOLD (1 << 16)
+
+typedef struct outputBuffer {
+    int fd;  // buffers with a negative fd only collect text
+    char *data;
+    size_t size;
+    size_t capacity;
+    struct outputPipe *pipe;  // writer thread that takes the flushed text, may be NULL
+} outputBuffer;
+
+void initOutputWithCapacity(outputBuffer *out, int fd, size_t capacity) {
+    out->fd = fd;
+    out->size = 0;
+    out->capacity = capacity;
+    out->data = (char *)malloc(out->capacity);
+    out->pipe = NULL;
+}
 
-    // Update parent pointers
-    y->parent = x->parent;
-    x->parent = y;
-    if (T2 != NULL) {
-        T2->parent = x;
+// Writer stage of --pipeline: full buffers go to a thread that does the
+// write() calls and sends them back empty
+#define OUTPUT_PIPE_CHUNKS 8
+
+typedef struct outputPipe {
+    spscRing full;  // buffers to write, NULL after the last one
+    spscRing free;
+    outputBuffer chunks[OUTPUT_PIPE_CHUNKS];
+    pthread_t thread;
+} outputPipe;
+
+static void *runOutputWriter(void *argument) {
+    outputPipe *pipe = (outputPipe *)argument;
+    outputBuffer *chunk;
+    while ((chunk = (outputBuffer *)ringPop(&pipe->full)) != NULL) {
+        size_t written = 0;
+        while (written < chunk->size) {
+            ssize_t result = write(chunk->fd, chunk->data + written, chunk->size - written);
+            if (result <= 0) {
+                break;
+            }
+            written += result;
+        }
+        chunk->size = 0;
+        ringPush(&pipe->free, chunk);
     }
-
-    updateHeight(x);
-    updateHeight(y);
-
-    return y;
+    return NULL;
 }
 
-// Helper function to get the balance factor of a node
-int getBalanceFactor(station *node) {
-    if (node == NULL) {
-        return 0;
+// Hand what out holds to the writer thread and continue in an empty buffer
+static void handOffOutput(outputBuffer *out) {
+    if (out->size == 0) {
+        return;
     }
-    return getHeight(node->left) - getHeight(node->right);
+    outputBuffer *chunk = (outputBuffer *)ringPop(&out->pipe->free);
+    outputBuffer swap = *chunk;
+    chunk->data = out->data;
+    chunk->size = out->size;
+    chunk->capacity = out->capacity;
+    out->data = swap.data;
+    out->size = 0;
+    out->capacity = swap.capacity;
+    ringPush(&out->pipe->full, chunk);
 }
 
-// Recursive function to insert a station into an AVL tree
-station *insertStationInTreeAVL(station *root, station *newStation) {
-    // Perform the standard BST insertion
-    if (root == NULL) {
-        newStation->parent = NULL;
-        return newStation;
+// Move the write() calls of out to a thread of their own, false if it cannot start
+bool startOutputPipeline(outputBuffer *out) {
+    outputPipe *pipe = (outputPipe *)malloc(sizeof(outputPipe));
+    initRing(&pipe->full);
+    initRing(&pipe->free);
+    for (int i = 0; i < OUTPUT_PIPE_CHUNKS; i++) {
+        initOutputWithCapacity(&pipe->chunks[i], out->fd, out->capacity);
+        ringPush(&pipe->free, &pipe->chunks[i]);
     }
-
-    if (newStation->distance < root->distance) {
-        root->left = insertStationInTreeAVL(root->left, newStation);
-        root->left->parent = root;
-    } else if (newStation->distance > root->distance) {
-        root->right = insertStationInTreeAVL(root->right, newStation);
-        root->right->parent = root;
+    if (pthread_create(&pipe->thread, NULL, runOutputWriter, pipe) != 0) {
+        for (int i = 0; i < OUTPUT_PIPE_CHUNKS; i++) {
+            free(pipe->chunks[i].data);
+        }
+        destroyRing(&pipe->full);
+        destroyRing(&pipe->free);
+        free(pipe);
+        return false;
     }
+    out->pipe = pipe;
+    return true;
+}
 
-    // Update height of the current node
-    updateHeight(root);
+// Wait for the writer to drain and stop it
+void stopOutputPipeline(outputBuffer *out) {
+    outputPipe *pipe = out->pipe;
+    ringPush(&pipe->full, NULL);
+    pthread_join(pipe->thread, NULL);
+    for (int i = 0; i < OUTPUT_PIPE_CHUNKS; i++) {
+        free(pipe->chunks[i].data);
+    }
+    destroyRing(&pipe->full);
+    destroyRing(&pipe->free);
+    free(pipe);
+    out->pipe = NULL;
+}
 
-    // Get the balance factor of this node
-    int balance = getBalanceFactor(root);
+void initOutput(outputBuffer *out, int fd) {
+    initOutputWithCapacity(out, fd, OUTPUT_FLUSH_THRESHOLD * 2);
+}
 
-    // Left Heavy
-    if (balance > 1) {
-        if (newStation->distance < root->left->distance) {
-            // Left-Left case: Perform a right rotation
-            return rotateRight(root);
-        } else {
-            // Left-Right case: Perform a left rotation on left child and then a right rotation on root
-            root->left = rotateLeft(root->left);
-            return rotateRight(root);
+void flushOutput(outputBuffer *out) {
+    if (out->pipe) {
+        handOffOutput(out);
+        return;
+    }
+    size_t written = 0;
+    while (written < out->size) {
+        ssize_t result = write(out->fd, out->data + written, out->size - written);
+        if (result <= 0) {
+            break;
         }
+        written += result;
     }
+    out->size = 0;
+}
 
-    // Right Heavy
-    if (balance < -1) {
-        if (newStation->distance > root->right->distance) {
-            // Right-Right case: Perform a left rotation
-            return rotateLeft(root);
-        } else {
-            // Right-Left case: Perform a right rotation on right child and then a left rotation on root
-            root->right = rotateRight(root->right);
-            return rotateLeft(root);
-        }
+void freeOutput(outputBuffer *out) {
+    if (out->fd >= 0) {
+        flushOutput(out);
+    }
+    if (out->pipe) {
+        stopOutputPipeline(out);
     }
+    free(out->data);
+    out->data = NULL;
+}
 
-    // Return the unchanged node
-    return root;
+static inline void reserveOutput(outputBuffer *out, size_t length) {
+    if (out->size + length > out->capacity) {
+        while (out->size + length > out->capacity) {
+            out->capacity *= 2;
+        }
+        out->data = (char *)realloc(out->data, out->capacity);
+    }
 }
 
-bool insertOrUpdateStationInTree(station *bkpRoot, station **root, station *newStation) {
-    if (newStation == NULL) {
-        return false;
+static inline void commitOutput(outputBuffer *out) {
+    if (out->fd >= 0 && out->size >= OUTPUT_FLUSH_THRESHOLD) {
+        flushOutput(out);
     }
+}
 
-    // int initialHeight = (*root) ? (*root)->height : 0;
+void appendText(outputBuffer *out, const char *text, size_t length) {
+    reserveOutput(out, length);
+    memcpy(out->data + out->size, text, length);
+    out->size += length;
+    commitOutput(out);
+}
 
-    // Search for the existing node with the same distance
-    station *existingNode = findStation(*root, newStation->distance);
+void appendString(outputBuffer *out, const char *text) {
+    appendText(out, text, strlen(text));
+}
 
-    if (existingNode) {
-        return false;
+static inline void appendChar(outputBuffer *out, char c) {
+    reserveOutput(out, 1);
+    out->data[out->size++] = c;
+    commitOutput(out);
+}
+
+static const char digitPairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Integer to ASCII, two digits at a time, written straight into the buffer
+void appendInt(outputBuffer *out, int value) {
+    char digits[12];
+    char *p = digits + sizeof(digits);
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+
+    while (magnitude >= 100) {
+        unsigned int pair = (magnitude % 100) * 2;
+        magnitude /= 100;
+        p -= 2;
+        p[0] = digitPairs[pair];
+        p[1] = digitPairs[pair + 1];
+    }
+    if (magnitude >= 10) {
+        p -= 2;
+        p[0] = digitPairs[magnitude * 2];
+        p[1] = digitPairs[magnitude * 2 + 1];
     } else {
-        // Node doesn't exist, perform insertion
+        *--p = (char)('0' + magnitude);
+    }
+    if (value < 0) {
+        *--p = '-';
+    }
+    appendText(out, p, digits + sizeof(digits) - p);
+}
 
-        *root = insertStationInTreeAVL(*root, newStation);
+// --serve ends every answer with a newline so that clients can tell them
+// apart, the historic output has none after a direct reach
+static bool framedAnswers;
+
+// Answer of a finish within reach of the start
+static void appendDirectPath(outputBuffer *out, int start, int finish) {
+    appendInt(out, start);
+    appendChar(out, ' ');
+    appendInt(out, finish);
+    if (framedAnswers) {
+        appendChar(out, '\n');
+    }
+}
 
-        return true;
-        // int finalHeight = (*root) ? (*root)->height : 0;
-        // // If height increased, a new node was successfully inserted or updated
-        // return finalHeight > initialHeight;
+// Memory: fixed-size objects (stations, car pools, queue nodes, car entry
+// buffers of each capacity) are carved out of large per-type slabs. Freed
+// objects go on an intrusive free list and are reused before the slab grows,
+// and a whole slab is given back at once at teardown. Build with
+// -DUSE_SLAB_ALLOCATOR=0 to fall back to plain malloc/free, and with
+// -DSLAB_HUGE_PAGES to ask for transparent huge pages on the slab blocks.
+#ifndef USE_SLAB_ALLOCATOR
+#define USE_SLAB_ALLOCATOR 1
+#endif
+#define SLAB_BLOCK_SIZE (2 << 20)
+#define SLAB_HEADER_SIZE 16
+
+typedef struct slabAllocator {
+    size_t objectSize;
+    void *freeList;
+    char *bump;  // next never used object in the newest block
+    char *bumpEnd;
+    void *blocks;  // every block starts with a pointer to the previous one
+    long long live;       // objects handed out and not freed, for --memory-stats
+    long long numBlocks;
+} slabAllocator;
+
+#define SLAB_INITIALIZER(size) {(size) < sizeof(void *) ? sizeof(void *) : (size), NULL, NULL, NULL, NULL, 0, 0}
+
+void *allocateSlabBlock() {
+#ifdef SLAB_HUGE_PAGES
+    void *block = NULL;
+    if (posix_memalign(&block, SLAB_BLOCK_SIZE, SLAB_BLOCK_SIZE) != 0) {
+        return NULL;
     }
+    madvise(block, SLAB_BLOCK_SIZE, MADV_HUGEPAGE);
+    return block;
+#else
+    return malloc(SLAB_BLOCK_SIZE);
+#endif
 }
 
-char *addStation(station **root, int dist, int numCars, int *cars) {
-    if (numCars > MAX_AUTO) {
-        return "non aggiunta\n";
+void *slabAlloc(slabAllocator *slab) {
+    slab->live++;
+#if USE_SLAB_ALLOCATOR
+    if (slab->freeList) {
+        void *object = slab->freeList;
+        slab->freeList = *(void **)object;
+        return object;
     }
+    if (slab->bump + slab->objectSize > slab->bumpEnd) {
+        char *block = (char *)allocateSlabBlock();
+        if (!block) {
+            slab->live--;
+            return NULL;
+        }
+        slab->numBlocks++;
+        *(void **)block = slab->blocks;
+        slab->blocks = block;
+        slab->bump = block + SLAB_HEADER_SIZE;
+        slab->bumpEnd = block + SLAB_BLOCK_SIZE;
+    }
+    void *object = slab->bump;
+    slab->bump += slab->objectSize;
+    return object;
+#else
+    return malloc(slab->objectSize);
+#endif
+}
 
-    station *newStation = (station *)malloc(sizeof(station));
-    if (!newStation) {
-        return "memory allocation error\n";
+void slabFree(slabAllocator *slab, void *object) {
+    if (object) {
+        slab->live--;
+    }
+#if USE_SLAB_ALLOCATOR
+    if (object) {
+        *(void **)object = slab->freeList;
+        slab->freeList = object;
     }
+#else
+    free(object);
+#endif
+}
 
-    newStation->distance = dist;
-    // newStation->reachable = NULL;
-    newStation->left = NULL;
-    newStation->right = NULL;
-    newStation->carPool = createCarPool();  // Initialize the car list to NULL
-    // newStation->numCars = 0;                // Initialize the number of cars to 0
-    newStation->maxAutonomy = 0;  // Initialize max autonomy to 0
-    // newStation->deleted = false;
+// Give back every block of the slab, all the objects in it die together
+void slabRelease(slabAllocator *slab) {
+    void *block = slab->blocks;
+    while (block) {
+        void *previous = *(void **)block;
+        free(block);
+        block = previous;
+    }
+    slab->freeList = NULL;
+    slab->bump = NULL;
+    slab->bumpEnd = NULL;
+    slab->blocks = NULL;
+    slab->live = 0;
+    slab->numBlocks = 0;
+}
 
-    newStation->visited = false;
-    newStation->minWeight = INT_MAX;
-    newStation->pathPrevious = NULL;
-    newStation->steps = INT_MAX;
+// What the slab takes from the system: its blocks, or the objects themselves
+// when they come from malloc
+static size_t slabHeldBytes(slabAllocator *slab) {
+#if USE_SLAB_ALLOCATOR
+    return (size_t)slab->numBlocks * SLAB_BLOCK_SIZE;
+#else
+    return (size_t)slab->live * slab->objectSize;
+#endif
+}
 
-    newStation->height = 0;
+// car entry buffers come in power of two capacities, from 4 up to MAX_AUTO
+#define CAR_POOL_INITIAL_CAPACITY 4
+#define CAR_POOL_SIZE_CLASSES 8
+
+#if !COMPACT_STATIONS
+static slabAllocator stationSlab = SLAB_INITIALIZER(sizeof(station));
+#endif
+static slabAllocator carPoolSlab = SLAB_INITIALIZER(sizeof(carList));
+static slabAllocator carEntrySlabs[CAR_POOL_SIZE_CLASSES] = {
+    SLAB_INITIALIZER(4 * sizeof(carEntry)),   SLAB_INITIALIZER(8 * sizeof(carEntry)),   SLAB_INITIALIZER(16 * sizeof(carEntry)),
+    SLAB_INITIALIZER(32 * sizeof(carEntry)),  SLAB_INITIALIZER(64 * sizeof(carEntry)),  SLAB_INITIALIZER(128 * sizeof(carEntry)),
+    SLAB_INITIALIZER(256 * sizeof(carEntry)), SLAB_INITIALIZER(512 * sizeof(carEntry))};
+
+slabAllocator *getCarEntrySlab(int capacity) {
+    return &carEntrySlabs[__builtin_ctz(capacity) - __builtin_ctz(CAR_POOL_INITIAL_CAPACITY)];
+}
 
-    for (int i = 0; i < numCars && i < MAX_AUTO; i++) {
-        newStation->carPool->cars[i] = cars[i];
-        newStation->carPool->numCars++;
+// Station ids stay dense: the ids of demolished stations are handed out again
+// before new ones, so side arrays indexed by id never outgrow the network
+typedef struct stationIdPool {
+    int next;  // ids below this have been handed out at least once
+    int *released;
+    int numReleased;
+    int capacity;
+} stationIdPool;
 
-        if (cars[i] > newStation->maxAutonomy) {
-            newStation->maxAutonomy = cars[i];
-        }
+static stationIdPool stationIds = {0};
+
+int acquireStationId(void) {
+    if (stationIds.numReleased > 0) {
+        return stationIds.released[--stationIds.numReleased];
     }
+    return stationIds.next++;
+}
 
-    if (insertOrUpdateStationInTree(*root, root, newStation)) {
-        return "aggiunta\n";
-    } else {
-        // freeCarList(&newStation->cars);
-        freeCarPool(&newStation->carPool);
-        free(newStation);
-        return "non aggiunta\n";
+void releaseStationId(int id) {
+    if (stationIds.numReleased == stationIds.capacity) {
+        stationIds.capacity = stationIds.capacity ? stationIds.capacity * 2 : 1024;
+        stationIds.released = (int *)realloc(stationIds.released, stationIds.capacity * sizeof(int));
     }
+    stationIds.released[stationIds.numReleased++] = id;
 }
 
-// Function to find the node with the smallest value in a given AVL tree
-station *minValueNode(station *node) {
-    if (node == NULL) {
-        return NULL;
+void freeStationIds(void) {
+    free(stationIds.released);
+    memset(&stationIds, 0, sizeof(stationIds));
+}
+
+carList *createCarPool() {
+    carList *newCarPool = (carList *)slabAlloc(&carPoolSlab);
+    newCarPool->capacity = 0;
+    newCarPool->numValues = 0;
+    newCarPool->numCars = 0;
+    newCarPool->cars = NULL;
+
+    return newCarPool;
+}
+
+// Empty the pool and give its entries back
+void clearCarPool(carList *carPool) {
+    if (carPool->cars) {
+        slabFree(getCarEntrySlab(carPool->capacity), carPool->cars);
     }
-    // station *current = node;
-    while (node->left != NULL) {
-        node = node->left;
+    memset(carPool, 0, sizeof(*carPool));
+}
+
+void freeCarPool(carList **carPoolToRemove) {
+    if (*carPoolToRemove) {
+        clearCarPool(*carPoolToRemove);
+        slabFree(&carPoolSlab, *carPoolToRemove);
+        *carPoolToRemove = NULL;
     }
-    return node;
 }
 
-station *maxValueNode(station *node) {
-    if (node == NULL) {
+#if COMPACT_STATIONS
+static void *reserveCompactPool(size_t objectSize) {
+    void *pool = mmap(NULL, (size_t)COMPACT_MAX_STATIONS * objectSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return pool == MAP_FAILED ? NULL : pool;
+}
+
+// The slot of a new station with an empty car pool, NULL when the pool cannot
+// be reserved or is full
+station *allocateCompactStation(void) {
+    if (!stationPool) {
+        stationPool = (station *)reserveCompactPool(sizeof(station));
+        carPools = (carList *)reserveCompactPool(sizeof(carList));
+        if (!stationPool || !carPools) {
+            return NULL;
+        }
+    }
+    int id = acquireStationId();
+    if (id >= COMPACT_MAX_STATIONS) {
+        releaseStationId(id);
         return NULL;
     }
+    memset(&carPools[id], 0, sizeof(carList));
+    return &stationPool[id];
+}
 
-    while (node->right != NULL) {
-        node = node->right;
+void releaseCompactPools(void) {
+    if (stationPool) {
+        munmap(stationPool, (size_t)COMPACT_MAX_STATIONS * sizeof(station));
     }
-
-    return node;
+    if (carPools) {
+        munmap(carPools, (size_t)COMPACT_MAX_STATIONS * sizeof(carList));
+    }
+    stationPool = NULL;
+    carPools = NULL;
+}
+#endif
+
+// Give back everything the station owns and the station itself
+void destroyStation(station *node) {
+    releaseStationId(stationId(node));
+#if COMPACT_STATIONS
+    clearCarPool(stationCars(node));
+#else
+    freeCarPool(&node->carPool);
+    slabFree(&stationSlab, node);
+#endif
 }
 
-// Recursive function to remove a station from an AVL tree
-void removeStationFromTreeAVL(station **root, int distance) {
-    if (*root == NULL) {
-        printf("non demolita\n");
+void reserveCarPool(carList *carPool, int capacity) {
+    if (capacity <= carPool->capacity) {
         return;
     }
+    int newCapacity = carPool->capacity ? carPool->capacity : CAR_POOL_INITIAL_CAPACITY;
+    while (newCapacity < capacity) {
+        newCapacity *= 2;
+    }
+    carEntry *cars = (carEntry *)slabAlloc(getCarEntrySlab(newCapacity));
+    if (carPool->cars) {
+        memcpy(cars, carPool->cars, carPool->numValues * sizeof(carEntry));
+        slabFree(getCarEntrySlab(carPool->capacity), carPool->cars);
+    }
+    carPool->cars = cars;
+    carPool->capacity = newCapacity;
+}
 
-    if (distance < (*root)->distance) {
-        removeStationFromTreeAVL(&(*root)->left, distance);
-    } else if (distance > (*root)->distance) {
-        removeStationFromTreeAVL(&(*root)->right, distance);
-    } else {
-        if ((*root)->left == NULL || (*root)->right == NULL) {
-            station *temp = (*root)->left ? (*root)->left : (*root)->right;
+// Scan kernels. Two searches run in tight loops over contiguous ints: the
+// frontier boundary of the sweep on the read index (how far along the sorted
+// distances a station reaches) and the lower bound in a car pool. Each has a
+// scalar version and, on x86, SSE4.1 and AVX2 ones compiled with target
+// attributes; selectKernels picks the widest one the CPU runs, --kernels
+// forces one and --bench-kernels times them all. -DSIMD_KERNELS=0 leaves only
+// the scalar ones.
+#ifndef SIMD_KERNELS
+#define SIMD_KERNELS 1
+#endif
+#if SIMD_KERNELS && !defined(__x86_64__) && !defined(__i386__)
+#undef SIMD_KERNELS
+#define SIMD_KERNELS 0
+#endif
+// binary search narrows a car pool down to this many entries, the kernel
+// scans the rest
+#define CAR_SCAN_WINDOW 16
+
+typedef struct scanKernels {
+    const char *name;
+    // first position of [from, to) with distances[position] > limit, to if none
+    int (*scanAbove)(const int *distances, int from, int to, int limit);
+    // last position of [to, from] with distances[position] < limit, to - 1 if none
+    int (*scanBelow)(const int *distances, int from, int to, int limit);
+    // first entry of [from, to) with autonomy >= carAutonomy, to if none
+    int (*scanCars)(const carEntry *cars, int from, int to, int carAutonomy);
+} scanKernels;
+
+static int scanAboveScalar(const int *distances, int from, int to, int limit) {
+    while (from < to && distances[from] <= limit) {
+        from++;
+    }
+    return from;
+}
 
-            if (temp == NULL) {
-                freeCarPool(&(*root)->carPool);
-                free(*root);
-                *root = NULL;
-            } else {
-                // *root = *temp;  // Copy the contents of the non-empty child
-                (*root)->distance = temp->distance;
-                // freeCarList(&(*root)->cars);
-                freeCarPool(&(*root)->carPool);
-                // freeReachList(&(*root)->reachable);
-                (*root)->carPool = temp->carPool;
-                // (*root)->deleted = temp->deleted;
-                (*root)->height = temp->height;
-                // (*root)->alreadyInQueue = temp->alreadyInQueue;
-                (*root)->maxAutonomy = temp->maxAutonomy;
-                (*root)->minWeight = temp->minWeight;
-                // (*root)->numCars = temp->numCars;
-                (*root)->pathPrevious = temp->pathPrevious;
-                // (*root)->reachable = temp->reachable;
-                (*root)->steps = temp->steps;
-                (*root)->visited = temp->visited;
-                (*root)->left = temp->left;
-                (*root)->right = temp->right;
-            }
-            free(temp);
-            printf("demolita\n");
-
-        } else {
-            // Node with two children, get the inorder successor (smallest in the right subtree)
-            station *temp = minValueNode((*root)->right);
-
-            // Copy the inorder successor's data to this node
-            (*root)->distance = temp->distance;
-            // freeCarList(&(*root)->cars);
-            freeCarPool(&(*root)->carPool);
-            // freeReachList(&(*root)->reachable);
-            (*root)->carPool = temp->carPool;
-            // (*root)->deleted = temp->deleted;
-            // left right height remain the same
-            // (*root)->alreadyInQueue = temp->alreadyInQueue;
-            (*root)->maxAutonomy = temp->maxAutonomy;
-            (*root)->minWeight = temp->minWeight;
-            // (*root)->numCars = temp->numCars;
-            (*root)->pathPrevious = temp->pathPrevious;
-            // (*root)->reachable = temp->reachable;
-            (*root)->steps = temp->steps;
-            (*root)->visited = temp->visited;
-
-            // remove pointer cars and reachable
-            temp->carPool = NULL;
-            // temp->reachable = NULL;
-
-            // Update parent pointer for the successor node's parent
-            // if (temp->parent == *root) {
-            //     (*root)->right = temp->right;  // Update right pointer
-            // } else {
-            //     temp->parent->left = temp->right;  // Update left pointer of successor's parent
-            // }
-
-            // Delete the inorder successor
-            removeStationFromTreeAVL(&(*root)->right, temp->distance);
-            // printf("demolita\n");
-
-            // Update parent pointers for the current subtree
-            if ((*root)->left) {
-                (*root)->left->parent = *root;
-            }
-            if ((*root)->right) {
-                (*root)->right->parent = *root;
-            }
-        }
-    }
-
-    // If the tree had only one node, then return
-    if ((*root) == NULL) {
-        return;
+static int scanBelowScalar(const int *distances, int from, int to, int limit) {
+    while (from >= to && distances[from] >= limit) {
+        from--;
     }
+    return from;
+}
 
-    // Update height of the current node
-    updateHeight((*root));
+static int scanCarsScalar(const carEntry *cars, int from, int to, int carAutonomy) {
+    while (from < to && cars[from].autonomy < carAutonomy) {
+        from++;
+    }
+    return from;
+}
 
-    // Get the balance factor of this node
-    int balance = getBalanceFactor((*root));
+static const scanKernels scalarKernels = {"scalar", scanAboveScalar, scanBelowScalar, scanCarsScalar};
 
-    // Left Heavy
-    if (balance > 1) {
-        if (getBalanceFactor((*root)->left) >= 0) {
-            // Left-Left case: Perform a right rotation
-            *root = rotateRight(*root);
-        } else {
-            // Left-Right case: Perform a left rotation on left child and then a right rotation on *root
-            (*root)->left = rotateLeft((*root)->left);
-            *root = rotateRight(*root);
+#if SIMD_KERNELS
+// A carEntry is two ints, the autonomies are the even lanes
+#define CAR_LANES_SSE 0x5
+#define CAR_LANES_AVX 0x55
+
+__attribute__((target("sse4.1"))) static int scanAboveSse(const int *distances, int from, int to, int limit) {
+    __m128i bound = _mm_set1_epi32(limit);
+    for (; from + 4 <= to; from += 4) {
+        __m128i values = _mm_loadu_si128((const __m128i *)(distances + from));
+        int above = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(values, bound)));
+        if (above) {
+            return from + __builtin_ctz(above);
         }
     }
+    return scanAboveScalar(distances, from, to, limit);
+}
 
-    // Right Heavy
-    if (balance < -1) {
-        if (getBalanceFactor((*root)->right) <= 0) {
-            // Right-Right case: Perform a left rotation
-            *root = rotateLeft(*root);
-        } else {
-            // Right-Left case: Perform a right rotation on right child and then a left rotation on *root
-            (*root)->right = rotateRight((*root)->right);
-            *root = rotateLeft(*root);
+__attribute__((target("sse4.1"))) static int scanBelowSse(const int *distances, int from, int to, int limit) {
+    __m128i bound = _mm_set1_epi32(limit);
+    for (; from - 3 >= to; from -= 4) {
+        __m128i values = _mm_loadu_si128((const __m128i *)(distances + from - 3));
+        int below = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(values, bound)));
+        if (below) {
+            return from - 3 + 31 - __builtin_clz(below);
         }
     }
+    return scanBelowScalar(distances, from, to, limit);
+}
 
-    if ((*root)->left) {
-        (*root)->left->parent = *root;
+__attribute__((target("sse4.1"))) static int scanCarsSse(const carEntry *cars, int from, int to, int carAutonomy) {
+    __m128i bound = _mm_set1_epi32(carAutonomy);
+    for (; from + 2 <= to; from += 2) {
+        __m128i values = _mm_loadu_si128((const __m128i *)(cars + from));
+        int notBelow = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(values, bound))) & CAR_LANES_SSE;
+        if (notBelow) {
+            return from + __builtin_ctz(notBelow) / 2;
+        }
     }
-    if ((*root)->right) {
-        (*root)->right->parent = *root;
+    return scanCarsScalar(cars, from, to, carAutonomy);
+}
+
+// The AVX2 tails run the scalar loops, inlined here with VEX encoding: handing
+// them to the SSE kernels costs a state transition on every call
+__attribute__((target("avx2"))) static int scanAboveAvx2(const int *distances, int from, int to, int limit) {
+    __m256i bound = _mm256_set1_epi32(limit);
+    for (; from + 8 <= to; from += 8) {
+        __m256i values = _mm256_loadu_si256((const __m256i *)(distances + from));
+        int above = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(values, bound)));
+        if (above) {
+            return from + __builtin_ctz(above);
+        }
     }
+    return scanAboveScalar(distances, from, to, limit);
 }
 
-char *addCar(station **root, int distance, int carAutonomy) {
-    station *current = findStation(*root, distance);
-    if (!current) {
-        return "non aggiunta\n";
+__attribute__((target("avx2"))) static int scanBelowAvx2(const int *distances, int from, int to, int limit) {
+    __m256i bound = _mm256_set1_epi32(limit);
+    for (; from - 7 >= to; from -= 8) {
+        __m256i values = _mm256_loadu_si256((const __m256i *)(distances + from - 7));
+        int below = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(bound, values)));
+        if (below) {
+            return from - 7 + 31 - __builtin_clz(below);
+        }
     }
-    if (current->carPool->numCars < MAX_AUTO) {
-        current->carPool->cars[current->carPool->numCars] = carAutonomy;
-        current->carPool->numCars++;
+    return scanBelowScalar(distances, from, to, limit);
+}
 
-        if (carAutonomy > current->maxAutonomy) {
-            current->maxAutonomy = carAutonomy;
+__attribute__((target("avx2"))) static int scanCarsAvx2(const carEntry *cars, int from, int to, int carAutonomy) {
+    __m256i bound = _mm256_set1_epi32(carAutonomy);
+    for (; from + 4 <= to; from += 4) {
+        __m256i values = _mm256_loadu_si256((const __m256i *)(cars + from));
+        int notBelow = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(bound, values))) & CAR_LANES_AVX;
+        if (notBelow) {
+            return from + __builtin_ctz(notBelow) / 2;
         }
-        return "aggiunta\n";
-    } else {
-        return "non aggiunta\n";
     }
+    return scanCarsScalar(cars, from, to, carAutonomy);
 }
 
-char *removeCar(station **root, int distance, int carAutonomy) {
-    station *current = findStation(*root, distance);
-    if (!current) {
-        return "non rottamata\n";
+static const scanKernels sseKernels = {"sse4", scanAboveSse, scanBelowSse, scanCarsSse};
+static const scanKernels avx2Kernels = {"avx2", scanAboveAvx2, scanBelowAvx2, scanCarsAvx2};
+#endif
+
+static scanKernels kernels = {"scalar", scanAboveScalar, scanBelowScalar, scanCarsScalar};
+
+// The kernel sets this CPU runs, widest first; returns how many
+static int availableKernels(const scanKernels **sets) {
+    int count = 0;
+#if SIMD_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        sets[count++] = &avx2Kernels;
     }
+    if (__builtin_cpu_supports("sse4.1")) {
+        sets[count++] = &sseKernels;
+    }
+#endif
+    sets[count++] = &scalarKernels;
+    return count;
+}
 
-    int newMaxAutonomy = 0;
-    bool removed = false;
-    for (int i = 0; i < current->carPool->numCars; i++) {
-        if (!removed && current->carPool->cars[i] == carAutonomy) {
-            if (i < current->carPool->numCars - 1)
-                current->carPool->cars[i] = current->carPool->cars[current->carPool->numCars - 1];
-            else
-                current->carPool->cars[i] = 0;
-            current->carPool->numCars--;
-            removed = true;
+// The widest kernels, or the ones called name; false when they do not run here
+static bool selectKernels(const char *name) {
+    const scanKernels *sets[3];
+    int count = availableKernels(sets);
+    for (int i = 0; i < count; i++) {
+        if (!name || strcmp(sets[i]->name, name) == 0) {
+            kernels = *sets[i];
+            return true;
         }
-        if (current->carPool->cars[i] > newMaxAutonomy)
-            newMaxAutonomy = current->carPool->cars[i];
     }
-    current->maxAutonomy = newMaxAutonomy;
+    return false;
+}
 
-    if (removed)
-        return "rottamata\n";
-    else
-        return "non rottamata\n";
+// Index of the first entry with autonomy >= carAutonomy
+int findCarEntry(carList *carPool, int carAutonomy) {
+    int low = 0;
+    int high = carPool->numValues;
+    while (high - low > CAR_SCAN_WINDOW) {
+        int middle = (low + high) / 2;
+        if (carPool->cars[middle].autonomy < carAutonomy) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return kernels.scanCars(carPool->cars, low, high, carAutonomy);
 }
 
-typedef struct queueNode {
-    station *station;
-} queueNode;
+// Same value as the old linear rescan: 0 for an empty pool
+int getMaxAutonomy(carList *carPool) {
+    if (carPool->numValues == 0 || carPool->cars[carPool->numValues - 1].autonomy < 0) {
+        return 0;
+    }
+    return carPool->cars[carPool->numValues - 1].autonomy;
+}
 
-typedef struct PriorityQueue {
-    queueNode **heapArray;
-    int capacity;
-    int size;
-} PriorityQueue;
+bool insertCarInPool(carList *carPool, int carAutonomy) {
+    if (carPool->numCars >= MAX_AUTO) {
+        return false;
+    }
 
-PriorityQueue *createPriorityQueue(int capacity) {
-    PriorityQueue *pq = (PriorityQueue *)malloc(sizeof(PriorityQueue));
-    pq->capacity = capacity;
-    pq->size = 0;
-    pq->heapArray = (queueNode **)malloc(capacity * sizeof(queueNode *));
+    int index = findCarEntry(carPool, carAutonomy);
+    if (index < carPool->numValues && carPool->cars[index].autonomy == carAutonomy) {
+        carPool->cars[index].count++;
+    } else {
+        reserveCarPool(carPool, carPool->numValues + 1);
+        memmove(&carPool->cars[index + 1], &carPool->cars[index], (carPool->numValues - index) * sizeof(carEntry));
+        carPool->cars[index].autonomy = carAutonomy;
+        carPool->cars[index].count = 1;
+        carPool->numValues++;
+    }
+    carPool->numCars++;
+    return true;
+}
 
-    // Initialize heapArray pointers
-    for (int i = 0; i < capacity; i++) {
-        pq->heapArray[i] = NULL;
+bool removeCarFromPool(carList *carPool, int carAutonomy) {
+    int index = findCarEntry(carPool, carAutonomy);
+    if (index == carPool->numValues || carPool->cars[index].autonomy != carAutonomy) {
+        return false;
     }
 
-    return pq;
+    if (--carPool->cars[index].count == 0) {
+        memmove(&carPool->cars[index], &carPool->cars[index + 1], (carPool->numValues - index - 1) * sizeof(carEntry));
+        carPool->numValues--;
+    }
+    carPool->numCars--;
+    return true;
 }
 
-void swap(queueNode **a, queueNode **b) {
-    queueNode *temp = *a;
-    *a = *b;
-    *b = temp;
+int compareAutonomies(const void *a, const void *b) {
+    int first = *(const int *)a;
+    int second = *(const int *)b;
+    return (first > second) - (first < second);
 }
 
-void heapifyUp(PriorityQueue *pq, int index) {
-    while (index > 0) {
-        int parentIndex = (index - 1) / 2;
-
-        if (pq->heapArray[parentIndex] != NULL &&
-            (pq->heapArray[parentIndex]->station->steps > pq->heapArray[index]->station->steps ||
-             (pq->heapArray[parentIndex]->station->steps == pq->heapArray[index]->station->steps &&
-              pq->heapArray[parentIndex]->station->minWeight > pq->heapArray[index]->station->minWeight) ||
-             (pq->heapArray[parentIndex]->station->steps == pq->heapArray[index]->station->steps &&
-              pq->heapArray[parentIndex]->station->minWeight == pq->heapArray[index]->station->minWeight &&
-              pq->heapArray[parentIndex]->station->distance > pq->heapArray[index]->station->distance))) {
-            swap(&(pq->heapArray[parentIndex]), &(pq->heapArray[index]));
-            index = parentIndex;
+// Build the pool of a new station from the cars listed in aggiungi-stazione
+void fillCarPool(carList *carPool, int numCars, int *cars) {
+    if (numCars <= 0) {
+        return;
+    }
+    qsort(cars, numCars, sizeof(int), compareAutonomies);
+    reserveCarPool(carPool, numCars);
+
+    for (int i = 0; i < numCars; i++) {
+        if (carPool->numValues > 0 && carPool->cars[carPool->numValues - 1].autonomy == cars[i]) {
+            carPool->cars[carPool->numValues - 1].count++;
         } else {
-            break;
+            carPool->cars[carPool->numValues].autonomy = cars[i];
+            carPool->cars[carPool->numValues].count = 1;
+            carPool->numValues++;
         }
     }
+    carPool->numCars = numCars;
 }
 
-void resizeArray(PriorityQueue *pq, int newCapacity) {
-    pq->heapArray = (queueNode **)realloc(pq->heapArray, newCapacity * sizeof(queueNode *));
-    // Initialize heapArray pointers
-    for (int i = pq->capacity; i < newCapacity; i++) {
-        pq->heapArray[i] = NULL;
+#if STATION_INDEX == INDEX_AVL
+void printTreeDetails(station *root) {
+    if (root == NULL) {
+        return;
     }
-    pq->capacity = newCapacity;
-}
+    printTreeDetails(leftOf(root));
 
-void insertInQueue(PriorityQueue *pq, station *node) {
-    if (pq->size == pq->capacity) {
-        // Resize the array or perform other actions if needed
-        resizeArray(pq, pq->capacity * 2);
-        // return;
-    }
+    printf("Distance: %d\n", root->distance);
+    if (parentOf(root))
+        printf("Parent: %d\n", parentOf(root)->distance);
+    else
+        printf("Parent: NULL\n");
 
-    queueNode *newNode = (queueNode *)malloc(sizeof(queueNode));
-    newNode->station = node;
+    if (leftOf(root))
+        printf("Left: %d\n", leftOf(root)->distance);
+    else
+        printf("Left: NULL\n");
 
-    pq->heapArray[pq->size] = newNode;
-    pq->size++;
+    if (rightOf(root))
+        printf("Right: %d\n", rightOf(root)->distance);
+    else
+        printf("Right: NULL\n");
+    // if (root->deleted)
+    //     printf("DELETED\n");
+    // printf("maxAut: %d\n", root->maxAutonomy);
+    // printf("weight: %d\n", root->minWeight);
+    // printf("steps: %d\n", root->steps);
+    // if (root->pathPrevious)
+    //     printf("previous: %d\n", root->pathPrevious->distance);
+    // else
+    //     printf("previous: \n");
+    // printCars(root->cars);
+    // printf("Reachable Nodes: ");
+    // printReachableNodes(root->reachable);
+    // printf("Reachable By Nodes: ");
+    // printReachableNodes(root->reachableBy);
+    printf("\n");
 
-    heapifyUp(pq, pq->size - 1);
+    printTreeDetails(rightOf(root));
 }
 
-queueNode *pop(PriorityQueue *pq) {
-    if (pq->size == 0) {
-        return NULL;
+void freeTree(station *root) {
+    if (root != NULL) {
+        freeTree(leftOf(root));
+        freeTree(rightOf(root));
+        destroyStation(root);
     }
+}
 
-    queueNode *minNode = pq->heapArray[0];
-    pq->heapArray[0] = pq->heapArray[pq->size - 1];
-    pq->heapArray[pq->size - 1] = NULL;  // Clear the last position
-    pq->size--;
-
-    // Perform heapify-down operation to maintain heap property
-    int currentIndex = 0;
-    while (1) {
-        int leftChild = 2 * currentIndex + 1;
-        int rightChild = 2 * currentIndex + 2;
-        int smallest = currentIndex;
-
-        if (leftChild < pq->size &&
-            (pq->heapArray[leftChild]->station->steps < pq->heapArray[smallest]->station->steps ||
-             (pq->heapArray[leftChild]->station->steps == pq->heapArray[smallest]->station->steps &&
-              pq->heapArray[leftChild]->station->minWeight < pq->heapArray[smallest]->station->minWeight) ||
-             (pq->heapArray[leftChild]->station->steps == pq->heapArray[smallest]->station->steps &&
-              pq->heapArray[leftChild]->station->minWeight == pq->heapArray[smallest]->station->minWeight &&
-              pq->heapArray[leftChild]->station->distance < pq->heapArray[smallest]->station->distance))) {
-            smallest = leftChild;
-        }
-
-        if (rightChild < pq->size &&
-            (pq->heapArray[rightChild]->station->steps < pq->heapArray[smallest]->station->steps ||
-             (pq->heapArray[rightChild]->station->steps == pq->heapArray[smallest]->station->steps &&
-              pq->heapArray[rightChild]->station->minWeight < pq->heapArray[smallest]->station->minWeight) ||
-             (pq->heapArray[rightChild]->station->steps == pq->heapArray[smallest]->station->steps &&
-              pq->heapArray[rightChild]->station->minWeight == pq->heapArray[smallest]->station->minWeight &&
-              pq->heapArray[rightChild]->station->distance < pq->heapArray[smallest]->station->distance))) {
-            smallest = rightChild;
-        }
-
-        if (smallest != currentIndex) {
-            swap(&(pq->heapArray[currentIndex]), &(pq->heapArray[smallest]));
-            currentIndex = smallest;
+station *findStationInTreeAVL(station *root, int distance) {
+    while (root != NULL) {
+        if (root->distance == distance) {
+            return root;
+        } else if (distance < root->distance) {
+            root = leftOf(root);
         } else {
-            break;
+            root = rightOf(root);
         }
     }
-
-    return minNode;
+    return NULL;
 }
 
-station *getSuccessor(station *node) {
+// Helper function to get the height of a node
+int getHeight(station *node) {
     if (node == NULL) {
-        return NULL;
+        return 0;
     }
+    return node->height;
+}
 
-    // If the node has a right subtree, then the successor is the leftmost node in that subtree
-    if (node->right != NULL) {
-        return minValueNode(node->right);
-    }
+#if PATH_PLANNER == PLANNER_FRONTIER
+// One hop reach of a station, clamped to the int range
+static inline int ownReachRight(station *node) {
+    long long reach = (long long)node->distance + node->maxAutonomy;
+    return reach > INT_MAX ? INT_MAX : (int)reach;
+}
 
-    // Otherwise, traverse up the tree to find the first ancestor whose left child is also an ancestor of the given node
-    station *parent = node->parent;
-    while (parent != NULL && node == parent->right) {
-        node = parent;
-        parent = parent->parent;
-    }
-    return parent;
+static inline int ownReachLeft(station *node) {
+    long long reach = (long long)node->distance - node->maxAutonomy;
+    return reach < INT_MIN ? INT_MIN : (int)reach;
 }
 
-station *getPredecessor(station *node) {
-    if (node == NULL) {
-        return NULL;
+void updateReachBounds(station *node) {
+    node->reachRight = ownReachRight(node);
+    node->reachLeft = ownReachLeft(node);
+    if (leftOf(node)) {
+        if (leftOf(node)->reachRight > node->reachRight) {
+            node->reachRight = leftOf(node)->reachRight;
+        }
+        if (leftOf(node)->reachLeft < node->reachLeft) {
+            node->reachLeft = leftOf(node)->reachLeft;
+        }
     }
-
-    // If the node has a left subtree, then the predecessor is the rightmost node in that subtree
-    if (node->left != NULL) {
-        return maxValueNode(node->left);
+    if (rightOf(node)) {
+        if (rightOf(node)->reachRight > node->reachRight) {
+            node->reachRight = rightOf(node)->reachRight;
+        }
+        if (rightOf(node)->reachLeft < node->reachLeft) {
+            node->reachLeft = rightOf(node)->reachLeft;
+        }
     }
+}
+#endif
 
-    // Otherwise, traverse up the tree to find the first ancestor whose right child is also an ancestor of the given node
-    station *parent = node->parent;
-    while (parent != NULL && node == parent->left) {
-        node = parent;
-        parent = parent->parent;
+// Helper function to update the height of a node, and its reach bounds when
+// the frontier planner keeps them
+void updateHeight(station *node) {
+    if (node == NULL) {
+        return;
     }
-    return parent;
+    int leftHeight = getHeight(leftOf(node));
+    int rightHeight = getHeight(rightOf(node));
+    node->height = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+#if PATH_PLANNER == PLANNER_FRONTIER
+    updateReachBounds(node);
+#endif
 }
 
-void insertReachableStationsInQueue(station *root, station *toCheckStation, PriorityQueue *headQueue, bool *found, int start, int finish, bool firstInsert, station **currentBiggest, station **currentLowest) {
-    if (toCheckStation->distance == finish) {
-        *found = true;
-    }
+// Helper function to perform a right rotation
+station *rotateRight(station *y) {
+    station *x = leftOf(y);
+    station *T2 = rightOf(x);
 
-    toCheckStation->visited = true;
+    setRight(x, y);
+    setLeft(y, T2);
 
-    if (!(*found)) {
-        station *temp = NULL;
-        if (start < finish)
-            temp = getSuccessor(*currentBiggest);
-        else
-            temp = getPredecessor(*currentLowest);
+    // Update parent pointers
+    setParent(x, parentOf(y));
+    setParent(y, x);
+    if (T2 != NULL) {
+        setParent(T2, y);
+    }
 
-        while (temp && abs(temp->distance - toCheckStation->distance) <= toCheckStation->maxAutonomy) {
-            if (!temp->visited) {
-                if (firstInsert) {
-                    temp->steps = toCheckStation->steps + 1;
-                    temp->minWeight = temp->distance;
-                    temp->pathPrevious = toCheckStation;
+    updateHeight(y);
+    updateHeight(x);
+    COUNT(rotations);
 
-                    insertInQueue(headQueue, temp);
-                } else {
-                    int checkValue = 0;
-                    if (temp->distance != finish)
-                        checkValue = (toCheckStation->minWeight < temp->distance) ? toCheckStation->minWeight : temp->distance;
-                    else
-                        checkValue = toCheckStation->minWeight;
+    return x;
+}
 
-                    if (temp->steps > toCheckStation->steps + 1) {
-                        temp->steps = toCheckStation->steps + 1;
-                        temp->minWeight = checkValue;
-                        temp->pathPrevious = toCheckStation;
+// Helper function to perform a left rotation
+station *rotateLeft(station *x) {
+    station *y = rightOf(x);
+    station *T2 = leftOf(y);
 
-                        insertInQueue(headQueue, temp);
+    setLeft(y, x);
+    setRight(x, T2);
 
-                    } else if (temp->steps == toCheckStation->steps + 1) {
-                        if (temp->minWeight > checkValue) {
-                            temp->steps = toCheckStation->steps + 1;
-                            temp->minWeight = checkValue;
-                            temp->pathPrevious = toCheckStation;
+    // Update parent pointers
+    setParent(y, parentOf(x));
+    setParent(x, y);
+    if (T2 != NULL) {
+        setParent(T2, x);
+    }
 
-                            insertInQueue(headQueue, temp);
+    updateHeight(x);
+    updateHeight(y);
+    COUNT(rotations);
 
-                        } else if (temp->minWeight == checkValue && temp->pathPrevious->distance > toCheckStation->distance) {
-                            temp->steps = toCheckStation->steps + 1;
-                            temp->minWeight = checkValue;
-                            temp->pathPrevious = toCheckStation;
+    return y;
+}
 
-                            insertInQueue(headQueue, temp);
-                        }
-                    }
-                }
-            }
+// Helper function to get the balance factor of a node
+int getBalanceFactor(station *node) {
+    if (node == NULL) {
+        return 0;
+    }
+    return getHeight(leftOf(node)) - getHeight(rightOf(node));
+}
 
-            if ((*currentBiggest)->distance < temp->distance)
-                *currentBiggest = temp;
-            if ((*currentLowest)->distance > temp->distance)
-                *currentLowest = temp;
+// Recursive function to insert a station into an AVL tree
+station *insertStationInTreeAVL(station *root, station *newStation) {
+    // Perform the standard BST insertion
+    if (root == NULL) {
+        setParent(newStation, NULL);
+        return newStation;
+    }
 
-            if (start < finish)
-                temp = getSuccessor(*currentBiggest);
-            else
-                temp = getPredecessor(*currentLowest);
-        }
+    if (newStation->distance < root->distance) {
+        setLeft(root, insertStationInTreeAVL(leftOf(root), newStation));
+        setParent(leftOf(root), root);
+    } else if (newStation->distance > root->distance) {
+        setRight(root, insertStationInTreeAVL(rightOf(root), newStation));
+        setParent(rightOf(root), root);
     }
-}
 
-void findPathHelper(station *root, station *startStation, bool *found, PriorityQueue *headQueue, int start, int finish) {
-    station *currentBiggest = startStation;
-    station *currentLowest = startStation;
-    // check start station and insert in queue the reachable stations
-    insertReachableStationsInQueue(root, startStation, headQueue, found, start, finish, true, &currentBiggest, &currentLowest);
+    // Update height of the current node
+    updateHeight(root);
 
-    // pop stations from queue and check them
-    while (headQueue->size != 0) {
-        queueNode *extracted = pop(headQueue);
-        if (extracted) {
-            station *toCheckStation = extracted->station;
-            free(extracted);
+    // Get the balance factor of this node
+    int balance = getBalanceFactor(root);
 
-            // printf("biggest: %d lowest: %d\n", currentBiggest->distance, currentLowest->distance);
-            insertReachableStationsInQueue(root, toCheckStation, headQueue, found, start, finish, false, &currentBiggest, &currentLowest);
+    // Left Heavy
+    if (balance > 1) {
+        if (newStation->distance < leftOf(root)->distance) {
+            // Left-Left case: Perform a right rotation
+            return rotateRight(root);
+        } else {
+            // Left-Right case: Perform a left rotation on left child and then a right rotation on root
+            setLeft(root, rotateLeft(leftOf(root)));
+            return rotateRight(root);
+        }
+    }
+
+    // Right Heavy
+    if (balance < -1) {
+        if (newStation->distance > rightOf(root)->distance) {
+            // Right-Right case: Perform a left rotation
+            return rotateLeft(root);
+        } else {
+            // Right-Left case: Perform a right rotation on right child and then a left rotation on root
+            setRight(root, rotateRight(rightOf(root)));
+            return rotateLeft(root);
         }
     }
+
+    // Return the unchanged node
+    return root;
 }
 
-void printPath3(station *startStation, station *finishStation, int finish) {
-    if (finishStation->distance == startStation->distance) {
-        printf("%d ", startStation->distance);
-        return;
+// Insert a station whose distance is known not to be in the tree
+void insertNewStationInTree(station **root, station *newStation) {
+    setLeft(newStation, NULL);
+    setRight(newStation, NULL);
+    newStation->height = 0;
+#if PATH_PLANNER == PLANNER_FRONTIER
+    updateReachBounds(newStation);
+#endif
+
+    *root = insertStationInTreeAVL(*root, newStation);
+}
+
+bool insertOrUpdateStationInTree(station **root, station *newStation) {
+    if (newStation == NULL) {
+        return false;
     }
-    printPath3(startStation, finishStation->pathPrevious, finish);
-    printf("%d", finishStation->distance);
-    if (finishStation->distance != finish) {
-        printf(" ");
+
+    // Search for the existing node with the same distance
+    station *existingNode = findStationInTreeAVL(*root, newStation->distance);
+
+    if (existingNode) {
+        return false;
     } else {
-        printf("\n");
+        // Node doesn't exist, perform insertion
+        insertNewStationInTree(root, newStation);
+        return true;
     }
 }
 
-void findPath(station *root, int start, int finish) {
-    if (start == finish) {
-        printf("%d\n", start);
-        return;
+// Perfectly balanced tree over sorted[low, high), distances strictly increasing
+station *buildTreeAVL(station **sorted, int low, int high, station *parent) {
+    if (low >= high) {
+        return NULL;
     }
-    station *startStation = findStation(root, start);
-    station *finishStation = findStation(root, finish);
+    int middle = low + (high - low) / 2;
+    station *root = sorted[middle];
+    setParent(root, parent);
+    setLeft(root, buildTreeAVL(sorted, low, middle, root));
+    setRight(root, buildTreeAVL(sorted, middle + 1, high, root));
+    updateHeight(root);
+    return root;
+}
 
-    if (startStation == NULL || finishStation == NULL) {
-        printf("nessun percorso\n");
-        return;
+// Function to find the node with the smallest value in a given AVL tree
+station *minValueNode(station *node) {
+    if (node == NULL) {
+        return NULL;
     }
-    if (abs(start - finish) <= startStation->maxAutonomy) {
-        printf("%d %d", start, finish);
-        return;
+    // station *current = node;
+    while (leftOf(node) != NULL) {
+        node = leftOf(node);
     }
+    return node;
+}
 
-    PriorityQueue *headQueue = createPriorityQueue(100);
-
-    bool found = false;
+station *maxValueNode(station *node) {
+    if (node == NULL) {
+        return NULL;
+    }
 
-    startStation->minWeight = 0;
-    startStation->steps = 0;
-    findPathHelper(root, startStation, &found, headQueue, start, finish);
-    if (!found) {
-        printf("nessun percorso\n");
-    } else {
-        printPath3(startStation, finishStation, finish);
+    while (rightOf(node) != NULL) {
+        node = rightOf(node);
     }
 
-    resetVisitedStations(root);
+    return node;
 }
 
-int main() {
-    char command[19];
-    int dist;
-    int numCars;
-    int cars[MAX_AUTO];
+// Recursive function to remove a station from an AVL tree, returns the new
+// root of the subtree. The node is unlinked rather than overwritten with its
+// successor, so *removed is the station that was stored at distance; it must
+// be NULL on entry and stays NULL when the distance is missing.
+station *removeStationFromTreeAVL(station *root, int distance, station **removed) {
+    if (root == NULL) {
+        return NULL;
+    }
 
-    int singleCar;
+    if (distance < root->distance) {
+        setLeft(root, removeStationFromTreeAVL(leftOf(root), distance, removed));
+    } else if (distance > root->distance) {
+        setRight(root, removeStationFromTreeAVL(rightOf(root), distance, removed));
+    } else {
+        *removed = root;
+        if (leftOf(root) == NULL || rightOf(root) == NULL) {
+            station *child = leftOf(root) ? leftOf(root) : rightOf(root);
+            if (child) {
+                setParent(child, parentOf(root));
+            }
+            root = child;
+        } else {
+            // Node with two children, unlink the inorder successor (smallest in the right subtree) and put it in place
+            station *successor = NULL;
+            station *right = removeStationFromTreeAVL(rightOf(root), minValueNode(rightOf(root))->distance, &successor);
+            setLeft(successor, leftOf(root));
+            setRight(successor, right);
+            setParent(successor, parentOf(root));
+            successor->height = root->height;
+            setParent(leftOf(successor), successor);
+            if (right) {
+                setParent(right, successor);
+            }
+            root = successor;
+        }
+    }
+
+    // Nothing removed, or the subtree had only one node
+    if (*removed == NULL || root == NULL) {
+        return root;
+    }
+
+    // Update height of the current node
+    updateHeight(root);
+
+    // Get the balance factor of this node
+    int balance = getBalanceFactor(root);
+
+    // Left Heavy
+    if (balance > 1) {
+        if (getBalanceFactor(leftOf(root)) >= 0) {
+            // Left-Left case: Perform a right rotation
+            root = rotateRight(root);
+        } else {
+            // Left-Right case: Perform a left rotation on left child and then a right rotation on root
+            setLeft(root, rotateLeft(leftOf(root)));
+            root = rotateRight(root);
+        }
+    }
+
+    // Right Heavy
+    if (balance < -1) {
+        if (getBalanceFactor(rightOf(root)) <= 0) {
+            // Right-Right case: Perform a left rotation
+            root = rotateLeft(root);
+        } else {
+            // Right-Left case: Perform a right rotation on right child and then a left rotation on root
+            setRight(root, rotateRight(rightOf(root)));
+            root = rotateLeft(root);
+        }
+    }
+
+    if (leftOf(root)) {
+        setParent(leftOf(root), root);
+    }
+    if (rightOf(root)) {
+        setParent(rightOf(root), root);
+    }
+
+    return root;
+}
+
+station *getSuccessor(station *node) {
+    if (node == NULL) {
+        return NULL;
+    }
+
+    // If the node has a right subtree, then the successor is the leftmost node in that subtree
+    if (rightOf(node) != NULL) {
+        return minValueNode(rightOf(node));
+    }
+
+    // Otherwise, traverse up the tree to find the first ancestor whose left child is also an ancestor of the given node
+    station *parent = parentOf(node);
+    while (parent != NULL && node == rightOf(parent)) {
+        COUNT(successorClimbs);
+        node = parent;
+        parent = parentOf(parent);
+    }
+    return parent;
+}
+
+station *getPredecessor(station *node) {
+    if (node == NULL) {
+        return NULL;
+    }
+
+    // If the node has a left subtree, then the predecessor is the rightmost node in that subtree
+    if (leftOf(node) != NULL) {
+        return maxValueNode(leftOf(node));
+    }
+
+    // Otherwise, traverse up the tree to find the first ancestor whose right child is also an ancestor of the given node
+    station *parent = parentOf(node);
+    while (parent != NULL && node == leftOf(parent)) {
+        COUNT(predecessorClimbs);
+        node = parent;
+        parent = parentOf(parent);
+    }
+    return parent;
+}
+#endif
+
+#if STATION_INDEX == INDEX_BPLUS
+static slabAllocator bplusLeafSlab = SLAB_INITIALIZER(sizeof(bplusLeaf));
+static slabAllocator bplusInnerSlab = SLAB_INITIALIZER(sizeof(bplusInner));
+
+// Position of the first distance >= distance, scanning the whole leaf keeps
+// the loop branch free
+static inline int findSlotInLeaf(bplusLeaf *leaf, int distance) {
+    int slot = 0;
+    for (int i = 0; i < leaf->count; i++) {
+        slot += leaf->distances[i] < distance;
+    }
+    return slot;
+}
+
+// Last child whose key is <= distance
+static inline int findChildInInner(bplusInner *node, int distance) {
+    int low = 1;
+    int high = node->count;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (node->keys[middle] <= distance) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low - 1;
+}
+
+// Descend to the leaf that holds (or would hold) distance, remembering the
+// inner nodes and child positions on the way down
+bplusLeaf *findLeafInBplus(stationIndex *index, int distance, bplusInner **path, int *pathSlots) {
+    void *node = index->root;
+    for (int level = 0; level < index->height; level++) {
+        int child = findChildInInner((bplusInner *)node, distance);
+        if (path) {
+            path[level] = (bplusInner *)node;
+            pathSlots[level] = child;
+        }
+        node = ((bplusInner *)node)->children[child];
+    }
+    return (bplusLeaf *)node;
+}
+
+station *findStationInBplus(stationIndex *index, int distance) {
+    if (index->root == NULL) {
+        return NULL;
+    }
+    bplusLeaf *leaf = findLeafInBplus(index, distance, NULL, NULL);
+    int slot = findSlotInLeaf(leaf, distance);
+    if (slot < leaf->count && leaf->distances[slot] == distance) {
+        return leaf->stations[slot];
+    }
+    return NULL;
+}
+
+static inline void placeInLeaf(bplusLeaf *leaf, int slot, station *node) {
+    leaf->distances[slot] = node->distance;
+    leaf->maxAutonomies[slot] = node->maxAutonomy;
+    leaf->stations[slot] = node;
+    node->leaf = leaf;
+    node->slot = slot;
+}
+
+// Shift the entries from slot on by one position to the right (shift = 1) or
+// to the left (shift = -1), keeping the back references of the stations right
+void shiftLeafEntries(bplusLeaf *leaf, int slot, int shift) {
+    int moved = leaf->count - slot;
+    memmove(&leaf->distances[slot + shift], &leaf->distances[slot], moved * sizeof(int));
+    memmove(&leaf->maxAutonomies[slot + shift], &leaf->maxAutonomies[slot], moved * sizeof(int));
+    memmove(&leaf->stations[slot + shift], &leaf->stations[slot], moved * sizeof(station *));
+    for (int i = slot + shift; i < leaf->count + shift; i++) {
+        leaf->stations[i]->slot = i;
+    }
+    leaf->count += shift;
+}
+
+// Add newChild (whose smallest distance is key) right after the child that
+// was followed at each level, splitting inner nodes on the way up
+void insertChildInBplus(stationIndex *index, bplusInner **path, int *pathSlots, int key, void *newChild) {
+    for (int level = index->height - 1; level >= 0; level--) {
+        bplusInner *node = path[level];
+        int position = pathSlots[level] + 1;
+
+        if (node->count < BPLUS_ORDER) {
+            memmove(&node->keys[position + 1], &node->keys[position], (node->count - position) * sizeof(int));
+            memmove(&node->children[position + 1], &node->children[position], (node->count - position) * sizeof(void *));
+            node->keys[position] = key;
+            node->children[position] = newChild;
+            node->count++;
+            return;
+        }
+
+        int keys[BPLUS_ORDER + 1];
+        void *children[BPLUS_ORDER + 1];
+        memcpy(keys, node->keys, position * sizeof(int));
+        memcpy(children, node->children, position * sizeof(void *));
+        keys[position] = key;
+        children[position] = newChild;
+        memcpy(&keys[position + 1], &node->keys[position], (BPLUS_ORDER - position) * sizeof(int));
+        memcpy(&children[position + 1], &node->children[position], (BPLUS_ORDER - position) * sizeof(void *));
+
+        bplusInner *sibling = (bplusInner *)slabAlloc(&bplusInnerSlab);
+        int half = (BPLUS_ORDER + 1) / 2;
+        node->count = half;
+        memcpy(node->keys, keys, half * sizeof(int));
+        memcpy(node->children, children, half * sizeof(void *));
+        sibling->count = BPLUS_ORDER + 1 - half;
+        memcpy(sibling->keys, &keys[half], sibling->count * sizeof(int));
+        memcpy(sibling->children, &children[half], sibling->count * sizeof(void *));
+
+        key = sibling->keys[0];
+        newChild = sibling;
+    }
+
+    // the root was split too
+    bplusInner *root = (bplusInner *)slabAlloc(&bplusInnerSlab);
+    root->count = 2;
+    root->keys[0] = 0;
+    root->children[0] = index->root;
+    root->keys[1] = key;
+    root->children[1] = newChild;
+    index->root = root;
+    index->height++;
+}
+
+bool insertStationInBplus(stationIndex *index, station *newStation) {
+    if (index->root == NULL) {
+        bplusLeaf *leaf = (bplusLeaf *)slabAlloc(&bplusLeafSlab);
+        leaf->count = 1;
+        leaf->previous = NULL;
+        leaf->next = NULL;
+        placeInLeaf(leaf, 0, newStation);
+        index->root = leaf;
+        index->height = 0;
+        index->first = leaf;
+        return true;
+    }
+
+    bplusInner *path[BPLUS_MAX_HEIGHT];
+    int pathSlots[BPLUS_MAX_HEIGHT];
+    bplusLeaf *leaf = findLeafInBplus(index, newStation->distance, path, pathSlots);
+    int slot = findSlotInLeaf(leaf, newStation->distance);
+    if (slot < leaf->count && leaf->distances[slot] == newStation->distance) {
+        return false;
+    }
+
+    if (leaf->count < BPLUS_ORDER) {
+        shiftLeafEntries(leaf, slot, 1);
+        placeInLeaf(leaf, slot, newStation);
+        return true;
+    }
+
+    // full leaf: the upper half moves to a new leaf chained after it
+    bplusLeaf *right = (bplusLeaf *)slabAlloc(&bplusLeafSlab);
+    int half = BPLUS_ORDER / 2;
+    right->count = 0;
+    for (int i = half; i < BPLUS_ORDER; i++) {
+        placeInLeaf(right, right->count++, leaf->stations[i]);
+    }
+    leaf->count = half;
+    right->previous = leaf;
+    right->next = leaf->next;
+    if (leaf->next) {
+        leaf->next->previous = right;
+    }
+    leaf->next = right;
+
+    if (slot >= half) {
+        shiftLeafEntries(right, slot - half, 1);
+        placeInLeaf(right, slot - half, newStation);
+    } else {
+        shiftLeafEntries(leaf, slot, 1);
+        placeInLeaf(leaf, slot, newStation);
+    }
+
+    insertChildInBplus(index, path, pathSlots, right->distances[0], right);
+    return true;
+}
+
+// Pack stations sorted by strictly increasing distance into full leaves and
+// stack the inner levels over them, the index must be empty
+void buildBplus(stationIndex *index, station **sorted, int count) {
+    if (count == 0) {
+        return;
+    }
+    int numNodes = (count + BPLUS_ORDER - 1) / BPLUS_ORDER;
+    void **nodes = (void **)malloc(numNodes * sizeof(void *));
+    int *keys = (int *)malloc(numNodes * sizeof(int));
+    bplusLeaf *previous = NULL;
+    for (int i = 0; i < numNodes; i++) {
+        // spread the stations evenly so the last leaf is not nearly empty
+        int begin = (int)((long long)count * i / numNodes);
+        int end = (int)((long long)count * (i + 1) / numNodes);
+        bplusLeaf *leaf = (bplusLeaf *)slabAlloc(&bplusLeafSlab);
+        leaf->count = 0;
+        for (int j = begin; j < end; j++) {
+            placeInLeaf(leaf, leaf->count++, sorted[j]);
+        }
+        leaf->previous = previous;
+        leaf->next = NULL;
+        if (previous) {
+            previous->next = leaf;
+        } else {
+            index->first = leaf;
+        }
+        previous = leaf;
+        nodes[i] = leaf;
+        keys[i] = sorted[begin]->distance;
+    }
+
+    index->height = 0;
+    while (numNodes > 1) {
+        int numParents = (numNodes + BPLUS_ORDER - 1) / BPLUS_ORDER;
+        for (int i = 0; i < numParents; i++) {
+            int begin = (int)((long long)numNodes * i / numParents);
+            int end = (int)((long long)numNodes * (i + 1) / numParents);
+            bplusInner *node = (bplusInner *)slabAlloc(&bplusInnerSlab);
+            node->count = end - begin;
+            memcpy(node->keys, &keys[begin], node->count * sizeof(int));
+            memcpy(node->children, &nodes[begin], node->count * sizeof(void *));
+            // begin >= i, so the level is rewritten in place behind the reads
+            nodes[i] = node;
+            keys[i] = node->keys[0];
+        }
+        numNodes = numParents;
+        index->height++;
+    }
+    index->root = nodes[0];
+    free(nodes);
+    free(keys);
+}
+
+void unlinkLeaf(stationIndex *index, bplusLeaf *leaf) {
+    if (leaf->previous) {
+        leaf->previous->next = leaf->next;
+    } else {
+        index->first = leaf->next;
+    }
+    if (leaf->next) {
+        leaf->next->previous = leaf->previous;
+    }
+    slabFree(&bplusLeafSlab, leaf);
+}
+
+// Drop the child at position from the inner node at level, and every inner
+// node that is left without children
+void removeChildFromBplus(stationIndex *index, bplusInner **path, int *pathSlots, int level, int position) {
+    for (; level >= 0; level--) {
+        bplusInner *node = path[level];
+        memmove(&node->keys[position], &node->keys[position + 1], (node->count - position - 1) * sizeof(int));
+        memmove(&node->children[position], &node->children[position + 1], (node->count - position - 1) * sizeof(void *));
+        node->count--;
+        if (node->count > 0) {
+            return;
+        }
+        slabFree(&bplusInnerSlab, node);
+        if (level == 0) {
+            index->root = NULL;
+            index->height = 0;
+            return;
+        }
+        position = pathSlots[level - 1];
+    }
+}
+
+// Unlink the station at distance and return it. Leaves are merged with their
+// right sibling once both fit in half a leaf; inner nodes are only dropped
+// when they become empty, so the height never exceeds the one of the biggest
+// network seen so far
+station *removeStationFromBplus(stationIndex *index, int distance) {
+    if (index->root == NULL) {
+        return NULL;
+    }
+
+    bplusInner *path[BPLUS_MAX_HEIGHT];
+    int pathSlots[BPLUS_MAX_HEIGHT];
+    bplusLeaf *leaf = findLeafInBplus(index, distance, path, pathSlots);
+    int slot = findSlotInLeaf(leaf, distance);
+    if (slot == leaf->count || leaf->distances[slot] != distance) {
+        return NULL;
+    }
+
+    station *removed = leaf->stations[slot];
+    shiftLeafEntries(leaf, slot + 1, -1);
+
+    if (index->height == 0) {
+        if (leaf->count == 0) {
+            unlinkLeaf(index, leaf);
+            index->root = NULL;
+        }
+        return removed;
+    }
+
+    bplusInner *parent = path[index->height - 1];
+    int position = pathSlots[index->height - 1];
+    if (leaf->count == 0) {
+        unlinkLeaf(index, leaf);
+        removeChildFromBplus(index, path, pathSlots, index->height - 1, position);
+    } else if (position + 1 < parent->count) {
+        bplusLeaf *right = (bplusLeaf *)parent->children[position + 1];
+        if (leaf->count + right->count <= BPLUS_ORDER / 2) {
+            for (int i = 0; i < right->count; i++) {
+                placeInLeaf(leaf, leaf->count++, right->stations[i]);
+            }
+            unlinkLeaf(index, right);
+            removeChildFromBplus(index, path, pathSlots, index->height - 1, position + 1);
+        }
+    }
+
+    // a root with a single child is useless
+    while (index->height > 0 && ((bplusInner *)index->root)->count == 1) {
+        bplusInner *oldRoot = (bplusInner *)index->root;
+        index->root = oldRoot->children[0];
+        index->height--;
+        slabFree(&bplusInnerSlab, oldRoot);
+    }
+    return removed;
+}
+
+station *getSuccessor(station *node) {
+    if (node == NULL) {
+        return NULL;
+    }
+    if (node->slot + 1 < node->leaf->count) {
+        return node->leaf->stations[node->slot + 1];
+    }
+    return node->leaf->next ? node->leaf->next->stations[0] : NULL;
+}
+
+station *getPredecessor(station *node) {
+    if (node == NULL) {
+        return NULL;
+    }
+    if (node->slot > 0) {
+        return node->leaf->stations[node->slot - 1];
+    }
+    bplusLeaf *previous = node->leaf->previous;
+    return previous ? previous->stations[previous->count - 1] : NULL;
+}
+
+void freeBplusNodes(void *node, int height) {
+    if (height == 0) {
+        bplusLeaf *leaf = (bplusLeaf *)node;
+        for (int i = 0; i < leaf->count; i++) {
+            destroyStation(leaf->stations[i]);
+        }
+        slabFree(&bplusLeafSlab, leaf);
+        return;
+    }
+    bplusInner *inner = (bplusInner *)node;
+    for (int i = 0; i < inner->count; i++) {
+        freeBplusNodes(inner->children[i], height - 1);
+    }
+    slabFree(&bplusInnerSlab, inner);
+}
+#endif
+
+// Planner scratch space
+
+typedef struct sweepEntry {
+    station *node;
+    int previous;  // entry that discovered this one, -1 for the start
+    int layer;     // hops from the start
+} sweepEntry;
+
+// Search state of one station, kept out of the station itself. An entry only
+// holds for the query whose epoch it carries, older entries read as unset, so
+// nothing has to be cleared between queries.
+typedef struct plannerState {
+    unsigned int epoch;
+    int minWeight;
+    int steps;
+    bool visited;
+    int heapSlot;  // position in the queue, -1 when not queued
+    stationLink pathPrevious;
+} plannerState;
+
+typedef struct queueEntry {
+    uint64_t key;
+    int distance;
+    station *node;
+} queueEntry;
+
+typedef struct PriorityQueue {
+    queueEntry *heapArray;
+    int capacity;
+    int size;
+} PriorityQueue;
+
+// Buffers reused from one query to the next
+typedef struct plannerScratch {
+    sweepEntry *entries;
+    int capacity;
+    int count;
+    plannerState *states;  // indexed by station id
+    int stateCapacity;
+    unsigned int epoch;
+    PriorityQueue queue;
+    int *layerBounds;  // frontier planner: reach after each hop, then the stops
+    int *stops;
+    int layerCapacity;
+    long long swept;  // sweep entries of planPath, collected by the read index
+} plannerScratch;
+
+void freePlannerScratch(plannerScratch *scratch) {
+    free(scratch->entries);
+    free(scratch->states);
+    free(scratch->queue.heapArray);
+    free(scratch->layerBounds);
+    free(scratch->stops);
+    memset(scratch, 0, sizeof(*scratch));
+}
+
+// Start a new query: every state written so far becomes stale
+void beginPlannerQuery(plannerScratch *scratch) {
+    if (scratch->stateCapacity < stationIds.next) {
+        int capacity = scratch->stateCapacity ? scratch->stateCapacity : 1024;
+        while (capacity < stationIds.next) {
+            capacity *= 2;
+        }
+        scratch->states = (plannerState *)realloc(scratch->states, capacity * sizeof(plannerState));
+        memset(scratch->states + scratch->stateCapacity, 0, (capacity - scratch->stateCapacity) * sizeof(plannerState));
+        scratch->stateCapacity = capacity;
+    }
+    scratch->epoch++;
+    scratch->queue.size = 0;
+    if (scratch->epoch == 0) {
+        // the counter wrapped around, old stamps could look current again
+        memset(scratch->states, 0, scratch->stateCapacity * sizeof(plannerState));
+        scratch->epoch = 1;
+    }
+}
+
+static inline plannerState *getPlannerState(plannerScratch *scratch, station *node) {
+    plannerState *state = &scratch->states[stationId(node)];
+    if (state->epoch != scratch->epoch) {
+        state->epoch = scratch->epoch;
+        state->minWeight = INT_MAX;
+        state->steps = INT_MAX;
+        state->visited = false;
+        state->heapSlot = -1;
+        state->pathPrevious = stationLinkOf(NULL);
+    }
+    return state;
+}
+
+// Path cache: the answer to pianifica-percorso only depends on the stations
+// between start and finish, ends included, and on their maxAutonomy. Answers
+// are kept with that interval, least recently used first out, and an entry is
+// dropped as soon as a station inside its interval is added, demolished or
+// gets a different maxAutonomy. PATH_CACHE_SIZE 0 turns the cache off.
+#ifndef PATH_CACHE_SIZE
+#define PATH_CACHE_SIZE 1024
+#endif
+// longer answers are not worth keeping, they are cheap next to their output
+#define PATH_CACHE_MAX_TEXT 4096
+
+#if PATH_CACHE_SIZE > 0
+#define PATH_CACHE_BUCKETS (2 * PATH_CACHE_SIZE)
+
+typedef struct pathCacheEntry {
+    int start;
+    int finish;
+    char *text;
+    int length;
+    int newer;  // LRU links, -1 at the ends; older also chains the free slots
+    int older;
+    int nextInBucket;
+} pathCacheEntry;
+
+typedef struct pathCache {
+    pathCacheEntry entries[PATH_CACHE_SIZE];
+    // covered intervals, split out so invalidation scans two dense arrays;
+    // free slots have low > high and never match
+    int low[PATH_CACHE_SIZE];
+    int high[PATH_CACHE_SIZE];
+    int buckets[PATH_CACHE_BUCKETS];
+    int newest;
+    int oldest;
+    int freeSlots;
+    outputBuffer capture;  // a fresh answer is planned here, then copied
+    long long hits;
+    long long misses;
+    long long invalidations;
+    long long evictions;
+} pathCache;
+
+pathCache *createPathCache(void) {
+    pathCache *cache = (pathCache *)calloc(1, sizeof(pathCache));
+    for (int i = 0; i < PATH_CACHE_SIZE; i++) {
+        cache->low[i] = 1;
+        cache->high[i] = 0;
+        cache->entries[i].older = i + 1 < PATH_CACHE_SIZE ? i + 1 : -1;
+    }
+    for (int i = 0; i < PATH_CACHE_BUCKETS; i++) {
+        cache->buckets[i] = -1;
+    }
+    cache->newest = -1;
+    cache->oldest = -1;
+    cache->freeSlots = 0;
+    initOutput(&cache->capture, -1);
+    return cache;
+}
+
+void freePathCache(pathCache *cache) {
+    if (!cache) {
+        return;
+    }
+    for (int i = 0; i < PATH_CACHE_SIZE; i++) {
+        free(cache->entries[i].text);
+    }
+    freeOutput(&cache->capture);
+    free(cache);
+}
+
+static inline int pathCacheBucket(int start, int finish) {
+    uint64_t key = ((uint64_t)(uint32_t)start << 32) | (uint32_t)finish;
+    return (int)((key * 0x9E3779B97F4A7C15ull) >> 40) & (PATH_CACHE_BUCKETS - 1);
+}
+
+static void unlinkCacheEntry(pathCache *cache, int slot) {
+    pathCacheEntry *entry = &cache->entries[slot];
+    if (entry->newer != -1) {
+        cache->entries[entry->newer].older = entry->older;
+    } else {
+        cache->newest = entry->older;
+    }
+    if (entry->older != -1) {
+        cache->entries[entry->older].newer = entry->newer;
+    } else {
+        cache->oldest = entry->newer;
+    }
+}
+
+static void pushNewestCacheEntry(pathCache *cache, int slot) {
+    pathCacheEntry *entry = &cache->entries[slot];
+    entry->newer = -1;
+    entry->older = cache->newest;
+    if (cache->newest != -1) {
+        cache->entries[cache->newest].newer = slot;
+    } else {
+        cache->oldest = slot;
+    }
+    cache->newest = slot;
+}
+
+// Forget the entry in slot and put the slot back on the free chain
+static void dropCacheEntry(pathCache *cache, int slot) {
+    pathCacheEntry *entry = &cache->entries[slot];
+    int *link = &cache->buckets[pathCacheBucket(entry->start, entry->finish)];
+    while (*link != slot) {
+        link = &cache->entries[*link].nextInBucket;
+    }
+    *link = entry->nextInBucket;
+    unlinkCacheEntry(cache, slot);
+    cache->low[slot] = 1;
+    cache->high[slot] = 0;
+    entry->older = cache->freeSlots;
+    cache->freeSlots = slot;
+}
+
+pathCacheEntry *lookupPathCache(pathCache *cache, int start, int finish) {
+    for (int slot = cache->buckets[pathCacheBucket(start, finish)]; slot != -1; slot = cache->entries[slot].nextInBucket) {
+        pathCacheEntry *entry = &cache->entries[slot];
+        if (entry->start == start && entry->finish == finish) {
+            if (cache->newest != slot) {
+                unlinkCacheEntry(cache, slot);
+                pushNewestCacheEntry(cache, slot);
+            }
+            cache->hits++;
+            return entry;
+        }
+    }
+    cache->misses++;
+    return NULL;
+}
+
+void storePathCache(pathCache *cache, int start, int finish, const char *text, int length) {
+    if (length > PATH_CACHE_MAX_TEXT) {
+        return;
+    }
+    if (cache->freeSlots == -1) {
+        cache->evictions++;
+        dropCacheEntry(cache, cache->oldest);
+    }
+    int slot = cache->freeSlots;
+    pathCacheEntry *entry = &cache->entries[slot];
+    cache->freeSlots = entry->older;
+
+    entry->start = start;
+    entry->finish = finish;
+    if (length > entry->length || !entry->text) {
+        entry->text = (char *)realloc(entry->text, length > 0 ? length : 1);
+    }
+    memcpy(entry->text, text, length);
+    entry->length = length;
+    cache->low[slot] = start < finish ? start : finish;
+    cache->high[slot] = start < finish ? finish : start;
+
+    int bucket = pathCacheBucket(start, finish);
+    entry->nextInBucket = cache->buckets[bucket];
+    cache->buckets[bucket] = slot;
+    pushNewestCacheEntry(cache, slot);
+}
+
+// A station at distance changed: drop every answer whose interval holds it
+void invalidatePathCache(pathCache *cache, int distance) {
+    if (!cache || cache->newest == -1) {
+        return;
+    }
+    for (int slot = 0; slot < PATH_CACHE_SIZE; slot++) {
+        if (cache->low[slot] <= distance && distance <= cache->high[slot]) {
+            cache->invalidations++;
+            dropCacheEntry(cache, slot);
+        }
+    }
+}
+
+void printPathCacheStats(pathCache *cache, FILE *stream) {
+    fprintf(stream, "path cache: %lld hits, %lld misses, %lld invalidations, %lld evictions\n", cache->hits, cache->misses,
+            cache->invalidations, cache->evictions);
+}
+#else
+typedef struct pathCache pathCache;
+
+static inline void invalidatePathCache(pathCache *cache, int distance) {
+    (void)cache;
+    (void)distance;
+}
+#endif
+
+// Standing routes: registered (start, finish) pairs whose sweep is kept
+// between queries. The sweep processes its entries in a fixed order and an
+// entry only reads its own maxAutonomy, so when that changes everything
+// discovered before the entry was processed still holds: the entries after
+// that point are dropped and the sweep resumes from the changed entry. Added
+// or demolished stations inside the interval make the route plan again.
+
+typedef struct standingRoute {
+    int start;
+    int finish;
+    bool replan;      // plan from scratch at the next query
+    bool swept;       // the answer comes from the sweep, not from the checks before it
+    int resumeFrom;   // first entry to process again, -1 when up to date
+    int finishEntry;  // -1 when finish was not reached
+    plannerScratch sweep;
+    outputBuffer text;  // current answer
+} standingRoute;
+
+typedef struct standingRoutes {
+    standingRoute *routes;
+    int count;
+    int capacity;
+    long long replans;
+    long long repairs;
+    long long resumedEntries;  // entries the repairs did not have to sweep again
+    long long skipped;         // maxAutonomy changes the routes did not depend on
+} standingRoutes;
+
+static inline bool routeCovers(standingRoute *route, int distance) {
+    return route->start < route->finish ? route->start <= distance && distance <= route->finish
+                                        : route->finish <= distance && distance <= route->start;
+}
+
+// true when entry a is processed before entry b: forward in index order,
+// backward layer by layer, each layer from its last entry to its first
+static inline bool processedBefore(standingRoute *route, int a, int b) {
+    if (route->start < route->finish) {
+        return a < b;
+    }
+    sweepEntry *entries = route->sweep.entries;
+    return entries[a].layer < entries[b].layer || (entries[a].layer == entries[b].layer && a > b);
+}
+
+// Entry of the station at distance, -1 when the sweep did not reach it. The
+// entries are sorted by distance, increasing forward and decreasing backward.
+int findSweepEntry(plannerScratch *sweep, bool forward, int distance) {
+    sweepEntry *entries = sweep->entries;
+    int low = 0;
+    int high = sweep->count - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        int found = entries[middle].node->distance;
+        if (found == distance) {
+            return middle;
+        }
+        if ((found < distance) == forward) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return -1;
+}
+
+// A station was added or demolished at distance
+void markRoutesReplan(standingRoutes *routes, int distance) {
+    if (!routes) {
+        return;
+    }
+    for (int i = 0; i < routes->count; i++) {
+        if (routeCovers(&routes->routes[i], distance)) {
+            routes->routes[i].replan = true;
+        }
+    }
+}
+
+// The maxAutonomy of node is about to change
+void markRoutesChanged(standingRoutes *routes, station *node) {
+    if (!routes) {
+        return;
+    }
+    for (int i = 0; i < routes->count; i++) {
+        standingRoute *route = &routes->routes[i];
+        if (route->replan || !routeCovers(route, node->distance)) {
+            continue;
+        }
+        if (node->distance == route->start) {
+            // the start also decides whether finish is reached directly
+            route->replan = true;
+            continue;
+        }
+        int entry = route->swept ? findSweepEntry(&route->sweep, route->start < route->finish, node->distance) : -1;
+        if (entry == -1) {
+            routes->skipped++;
+            continue;
+        }
+        if (route->finishEntry != -1) {
+            // entries after the one that reached finish were never processed
+            int last = route->sweep.entries[route->finishEntry].previous;
+            if (entry != last && !processedBefore(route, entry, last)) {
+                routes->skipped++;
+                continue;
+            }
+        }
+        if (route->resumeFrom == -1 || processedBefore(route, entry, route->resumeFrom)) {
+            route->resumeFrom = entry;
+        }
+    }
+}
+
+void freeStandingRoutes(standingRoutes *routes) {
+    if (!routes) {
+        return;
+    }
+    for (int i = 0; i < routes->count; i++) {
+        freePlannerScratch(&routes->routes[i].sweep);
+        freeOutput(&routes->routes[i].text);
+    }
+    free(routes->routes);
+    free(routes);
+}
+
+// Reach index for conta-tappe over a sorted copy of the stations. Going
+// forward the stations reached within h hops from i are the positions from i
+// to R(h), and R(h + 1) is the farthest position reached in one hop by the
+// station of [i, R(h)] that reaches farthest, so the greedy jumps to that
+// station can be composed: jumps[k][i] is where 2^k of them lead from i and
+// a hop count takes O(log n). Backward is the mirror image.
+//
+// Reaches and jumps are offsets from their own position, so an added or
+// demolished station only shifts the arrays behind it with memmove and moves
+// the reach of the stations whose one hop window covers it. Changes keep the
+// reaches up to date and collect the positions whose reach moved; the next
+// query rebuilds level 0 for the windows that cover them and level k for the
+// positions that get to those windows within 2^k - 1 hops, found by walking
+// back window by window until no earlier station reaches further. In a
+// sparse network that is a few windows per level, where every station
+// reaches the next ones the top levels still span all the stations before
+// the change. Only the first use and growing the arrays copy the tree.
+
+typedef struct reachIndex {
+    int count;  // stations in the copy
+    int capacity;
+    int levels;
+    int autonomyBound;  // no station has a larger maxAutonomy
+    int *distances;
+    int *autonomies;
+    int *ahead;          // going forward the last position reached in one hop is i + ahead[i]
+    int *behind;         // going backward the first one is i - behind[i]
+    int *forwardJumps;   // levels * capacity offsets, level k at k * capacity
+    int *backwardJumps;
+    int *stack;
+    bool stale;         // the copy has to be taken from the stations again
+    int forwardLow;     // the forward reaches of forwardLow up to forwardHigh
+    int forwardHigh;    // changed since the last query, none when low > high
+    int backwardLow;
+    int backwardHigh;
+} reachIndex;
+
+void freeReachIndex(reachIndex *reach) {
+    if (!reach) {
+        return;
+    }
+    free(reach->distances);
+    free(reach->autonomies);
+    free(reach->ahead);
+    free(reach->behind);
+    free(reach->forwardJumps);
+    free(reach->backwardJumps);
+    free(reach->stack);
+    free(reach);
+}
+
+// Position of the station at distance in the copy, -1 if missing
+int findReachPosition(reachIndex *reach, int distance) {
+    int low = 0;
+    int high = reach->count - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (reach->distances[middle] == distance) {
+            return middle;
+        }
+        if (reach->distances[middle] < distance) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return -1;
+}
+
+// First position at distance >= distance, count if none
+static int reachLowerBound(reachIndex *reach, long long distance) {
+    int low = 0;
+    int high = reach->count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (reach->distances[middle] < distance) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static inline int farthestOf(reachIndex *reach, int position) {
+    return position + reach->ahead[position];
+}
+
+static inline int nearestOf(reachIndex *reach, int position) {
+    return position - reach->behind[position];
+}
+
+// One hop reach of the station at position from its autonomy
+static void setReachOfPosition(reachIndex *reach, int position) {
+    long long limit = (long long)reach->distances[position] + reach->autonomies[position];
+    int low = position;
+    int high = reach->count - 1;
+    while (low < high) {
+        int middle = low + (high - low + 1) / 2;
+        if (reach->distances[middle] <= limit) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    reach->ahead[position] = low - position;
+
+    limit = (long long)reach->distances[position] - reach->autonomies[position];
+    low = 0;
+    high = position;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (reach->distances[middle] >= limit) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    reach->behind[position] = position - low;
+}
+
+static inline void widenReachChange(int *low, int *high, int first, int last) {
+    if (first < *low) {
+        *low = first;
+    }
+    if (last > *high) {
+        *high = last;
+    }
+}
+
+// Move the entries from position on by delta (1 or -1) and the changed
+// ranges with them
+static void shiftReachArrays(reachIndex *reach, int position, int delta) {
+    size_t size = (size_t)(reach->count - position) * sizeof(int);
+    int *arrays[] = {reach->distances, reach->autonomies, reach->ahead, reach->behind};
+    for (int a = 0; a < 4; a++) {
+        memmove(arrays[a] + position + delta, arrays[a] + position, size);
+    }
+    for (int k = 0; k < reach->levels; k++) {
+        int *forward = reach->forwardJumps + (size_t)k * reach->capacity;
+        int *backward = reach->backwardJumps + (size_t)k * reach->capacity;
+        memmove(forward + position + delta, forward + position, size);
+        memmove(backward + position + delta, backward + position, size);
+    }
+    int *bounds[] = {&reach->forwardLow, &reach->forwardHigh, &reach->backwardLow, &reach->backwardHigh};
+    for (int b = 0; b < 4; b++) {
+        if (*bounds[b] >= position && *bounds[b] < reach->count) {
+            *bounds[b] += delta;
+        }
+    }
+    reach->count += delta;
+}
+
+// Forget the copy, the next query takes it again
+static inline void markReachIndexStale(reachIndex *reach) {
+    if (reach) {
+        reach->stale = true;
+    }
+}
+
+// The maxAutonomy of node is about to become maxAutonomy
+void updateReachIndex(reachIndex *reach, station *node, int maxAutonomy) {
+    if (!reach || reach->stale) {
+        return;
+    }
+    int position = findReachPosition(reach, node->distance);
+    reach->autonomies[position] = maxAutonomy;
+    if (maxAutonomy > reach->autonomyBound) {
+        reach->autonomyBound = maxAutonomy;
+    }
+    setReachOfPosition(reach, position);
+    widenReachChange(&reach->forwardLow, &reach->forwardHigh, position, position);
+    widenReachChange(&reach->backwardLow, &reach->backwardHigh, position, position);
+}
+
+// A station was added: the windows that cover it take one more position
+void reachStationAdded(reachIndex *reach, int distance, int maxAutonomy) {
+    if (!reach || reach->stale) {
+        return;
+    }
+    if (reach->count == reach->capacity) {
+        reach->stale = true;
+        return;
+    }
+    int position = reachLowerBound(reach, distance);
+    shiftReachArrays(reach, position, 1);
+    reach->distances[position] = distance;
+    reach->autonomies[position] = maxAutonomy;
+    if (maxAutonomy > reach->autonomyBound) {
+        reach->autonomyBound = maxAutonomy;
+    }
+    setReachOfPosition(reach, position);
+
+    int first = position;
+    for (int i = reachLowerBound(reach, (long long)distance - reach->autonomyBound); i < position; i++) {
+        if ((long long)reach->distances[i] + reach->autonomies[i] >= distance) {
+            reach->ahead[i]++;
+            first = i < first ? i : first;
+        }
+    }
+    int last = position;
+    long long limit = (long long)distance + reach->autonomyBound;
+    for (int i = position + 1; i < reach->count && reach->distances[i] <= limit; i++) {
+        if ((long long)reach->distances[i] - reach->autonomies[i] <= distance) {
+            reach->behind[i]++;
+            last = i;
+        }
+    }
+    widenReachChange(&reach->forwardLow, &reach->forwardHigh, first, position);
+    widenReachChange(&reach->backwardLow, &reach->backwardHigh, position, last);
+}
+
+// A station was demolished: the windows that covered it lose a position
+void reachStationRemoved(reachIndex *reach, int distance) {
+    if (!reach || reach->stale) {
+        return;
+    }
+    int position = findReachPosition(reach, distance);
+    int first = position;
+    for (int i = reachLowerBound(reach, (long long)distance - reach->autonomyBound); i < position; i++) {
+        if ((long long)reach->distances[i] + reach->autonomies[i] >= distance) {
+            reach->ahead[i]--;
+            first = i < first ? i : first;
+        }
+    }
+    int last = position;
+    long long limit = (long long)distance + reach->autonomyBound;
+    for (int i = position + 1; i < reach->count && reach->distances[i] <= limit; i++) {
+        if ((long long)reach->distances[i] - reach->autonomies[i] <= distance) {
+            reach->behind[i]--;
+            last = i;
+        }
+    }
+    shiftReachArrays(reach, position + 1, -1);
+    if (first < position) {
+        widenReachChange(&reach->forwardLow, &reach->forwardHigh, first, position - 1);
+    }
+    if (last > position) {
+        widenReachChange(&reach->backwardLow, &reach->backwardHigh, position, last - 1);
+    }
+}
+
+// Read index for pianifica-percorso bursts, -DREAD_INDEX=0 turns it off. The
+// stations are copied into a sorted array of distances and a parallel one of
+// maxAutonomy, which the sweep scans instead of walking the tree, and into an
+// Eytzinger (BFS order) array of distances and positions, whose lookups are
+// a branchless descent with the next levels prefetched. Added and demolished
+// stations make it stale, a new maxAutonomy is written through. The thread
+// that reads the commands rebuilds a stale index before a batch goes to the
+// planners, which only read it, once the queries planned on the tree since
+// it went stale have cost about what the copy costs, times a patience that
+// doubles whenever the previous copy went stale before it paid for itself
+// and halves when it did: bursts of queries run on the arrays, and changes
+// mixed with a few queries stop paying for copies nobody uses.
+#ifndef READ_INDEX
+#define READ_INDEX 1
+#endif
+// Sweeping a station of the tree takes about as long as copying two
+#define READ_INDEX_TREE_WEIGHT 2
+#define READ_INDEX_MAX_PATIENCE 64
+
+typedef struct eytzingerEntry {
+    int distance;
+    int position;  // in the sorted arrays
+} eytzingerEntry;
+
+typedef struct readIndex {
+    int count;
+    int capacity;
+    int *distances;
+    int *autonomies;
+    eytzingerEntry *tree;  // node k has children 2k and 2k + 1, tree[0] unused
+    bool borrowed;         // distances and autonomies are the arrays of a loaded snapshot
+    bool stale;
+    bool planning;        // the last batch was planned on the index
+    int patience;
+    long long treeWork;   // stations swept on the tree since the index went stale
+    long long indexWork;  // stations swept on the index since it was built
+    long long builds;
+    long long builtStations;
+    long long buildNanos;
+    long long indexQueries;  // planned on the arrays
+    long long treeQueries;   // planned on the tree while stale
+} readIndex;
+
+void freeReadIndex(readIndex *sorted) {
+    if (!sorted) {
+        return;
+    }
+    if (!sorted->borrowed) {
+        free(sorted->distances);
+        free(sorted->autonomies);
+    }
+    free(sorted->tree);
+    free(sorted);
+}
+
+// Position of the station at distance, -1 if missing
+static inline int findInReadIndex(const readIndex *sorted, int distance) {
+    const eytzingerEntry *tree = sorted->tree;
+    unsigned int k = 1;
+    while (k <= (unsigned int)sorted->count) {
+        // the 8 entries of a cache line hold the nodes three levels down
+        __builtin_prefetch(tree + 8 * k);
+        k = 2 * k + (tree[k].distance < distance);
+    }
+    // drop the right turns taken after the last left one
+    k >>= __builtin_ffs(~k);
+    return k != 0 && tree[k].distance == distance ? tree[k].position : -1;
+}
+
+static inline void markReadIndexStale(readIndex *sorted) {
+    if (sorted) {
+        sorted->stale = true;
+    }
+}
+
+// The station at distance now has maxAutonomy
+static inline void updateReadIndex(readIndex *sorted, int distance, int maxAutonomy) {
+    if (sorted && !sorted->stale) {
+        sorted->autonomies[findInReadIndex(sorted, distance)] = maxAutonomy;
+    }
+}
+
+// Concurrent readers (--concurrent). Planner threads do not read the tree,
+// whose rotations move nodes under them, but a networkView: the (distance,
+// maxAutonomy) pairs of every station in distance order, cut into blocks of
+// at most VIEW_BLOCK_SIZE, that is never written once published. The single
+// writer applies a mutation to the tree as before and to a private next view
+// that shares every untouched block with the published one, copying a block
+// the first time it changes, and publishes it with one atomic store when a
+// reader asks for a view after mutations. Readers announce the epoch they
+// read in; what a publication replaces (the old directory and the blocks
+// that were copied or dropped) is retired with the epoch and freed once no
+// reader is left in it. Stations and car pools stay with the writer and are
+// still freed right away.
+#ifndef VIEW_BLOCK_SIZE
+#define VIEW_BLOCK_SIZE 512
+#endif
+#define MAX_VIEW_READERS 128
+#define VIEW_IDLE ULLONG_MAX
+
+typedef struct viewBlock {
+    int count;
+    unsigned int version;  // the view that may still write it
+    int distances[VIEW_BLOCK_SIZE];
+    int autonomies[VIEW_BLOCK_SIZE];
+} viewBlock;
+
+typedef struct networkView {
+    unsigned int version;
+    int count;  // stations
+    int numBlocks;
+    int capacity;
+    viewBlock **blocks;
+    int *firsts;        // distance of the first station of every block
+    uint64_t checksum;  // sum of viewPairHash over the stations
+} networkView;
+
+typedef struct viewReader {
+    unsigned long long epoch;  // announced while reading, VIEW_IDLE in between
+    bool claimed;
+    char padding[64 - sizeof(unsigned long long) - sizeof(bool)];  // a cache line each
+} viewReader;
+
+typedef struct retiredMemory {
+    void *memory;
+    unsigned long long epoch;
+} retiredMemory;
+
+typedef struct viewDomain {
+    networkView *published;
+    networkView *next;  // writer only: the view being built, NULL when nothing changed
+    bool pending;       // there are changes to publish, readers check it
+    bool rebuild;       // the stations were replaced wholesale, next comes from the tree
+    unsigned long long epoch;
+    viewReader readers[MAX_VIEW_READERS];
+    viewBlock **replaced;  // blocks of the published view that next no longer uses
+    int numReplaced;
+    int replacedCapacity;
+    retiredMemory *retired;
+    int numRetired;
+    int retiredCapacity;
+    long long publications;
+    long long blocksCopied;
+    long long retiredCount;
+    long long reclaimedCount;
+} viewDomain;
+
+static inline uint64_t viewPairHash(int distance, int maxAutonomy) {
+    uint64_t x = (uint64_t)(uint32_t)distance << 32 | (uint32_t)maxAutonomy;
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    return x;
+}
+
+viewDomain *createViewDomain(void) {
+    viewDomain *views = (viewDomain *)calloc(1, sizeof(viewDomain));
+    for (int i = 0; i < MAX_VIEW_READERS; i++) {
+        views->readers[i].epoch = VIEW_IDLE;
+    }
+    // the first reader builds the first view from the tree
+    views->rebuild = true;
+    views->pending = true;
+    return views;
+}
+
+static networkView *allocateView(int capacity) {
+    networkView *view = (networkView *)malloc(sizeof(networkView) + capacity * (sizeof(viewBlock *) + sizeof(int)));
+    view->capacity = capacity;
+    view->blocks = (viewBlock **)(view + 1);
+    view->firsts = (int *)(view->blocks + capacity);
+    return view;
+}
+
+static viewBlock *allocateViewBlock(unsigned int version) {
+    viewBlock *block = (viewBlock *)malloc(sizeof(viewBlock));
+    block->count = 0;
+    block->version = version;
+    return block;
+}
+
+static void addToReplaced(viewDomain *views, viewBlock *block) {
+    if (views->numReplaced == views->replacedCapacity) {
+        views->replacedCapacity = views->replacedCapacity ? views->replacedCapacity * 2 : 64;
+        views->replaced = (viewBlock **)realloc(views->replaced, views->replacedCapacity * sizeof(viewBlock *));
+    }
+    views->replaced[views->numReplaced++] = block;
+}
+
+// The view the writer changes, a copy of the published directory at first
+static networkView *writableView(viewDomain *views) {
+    if (views->next) {
+        return views->next;
+    }
+    networkView *published = views->published;
+    networkView *next = allocateView(published->numBlocks + 16);
+    next->version = published->version + 1;
+    next->count = published->count;
+    next->numBlocks = published->numBlocks;
+    next->checksum = published->checksum;
+    memcpy(next->blocks, published->blocks, published->numBlocks * sizeof(viewBlock *));
+    memcpy(next->firsts, published->firsts, published->numBlocks * sizeof(int));
+    views->next = next;
+    __atomic_store_n(&views->pending, true, __ATOMIC_RELEASE);
+    return next;
+}
+
+static viewBlock *writableBlock(viewDomain *views, networkView *view, int block) {
+    viewBlock *shared = view->blocks[block];
+    if (shared->version == view->version) {
+        return shared;
+    }
+    viewBlock *copy = allocateViewBlock(view->version);
+    copy->count = shared->count;
+    memcpy(copy->distances, shared->distances, shared->count * sizeof(int));
+    memcpy(copy->autonomies, shared->autonomies, shared->count * sizeof(int));
+    view->blocks[block] = copy;
+    addToReplaced(views, shared);
+    views->blocksCopied++;
+    return copy;
+}
+
+// Block whose stations distance would go among: the last one starting at or
+// before it, the first one when none does
+static int findViewBlock(const networkView *view, int distance) {
+    int low = 0;
+    int high = view->numBlocks - 1;
+    while (low < high) {
+        int middle = low + (high - low + 1) / 2;
+        if (view->firsts[middle] <= distance) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+// First position of block holding a distance not below the given one
+static inline int lowerBoundInBlock(const viewBlock *block, int distance) {
+    int low = 0;
+    int high = block->count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (block->distances[middle] < distance) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Make room for one more block after position block of the directory
+static void insertViewBlock(networkView **viewSlot, int block, viewBlock *added) {
+    networkView *view = *viewSlot;
+    if (view->numBlocks == view->capacity) {
+        // never published, so it can simply be replaced
+        networkView *grown = allocateView(view->capacity * 2);
+        grown->version = view->version;
+        grown->count = view->count;
+        grown->numBlocks = view->numBlocks;
+        grown->checksum = view->checksum;
+        memcpy(grown->blocks, view->blocks, view->numBlocks * sizeof(viewBlock *));
+        memcpy(grown->firsts, view->firsts, view->numBlocks * sizeof(int));
+        free(view);
+        view = *viewSlot = grown;
+    }
+    memmove(view->blocks + block + 2, view->blocks + block + 1, (view->numBlocks - block - 1) * sizeof(viewBlock *));
+    memmove(view->firsts + block + 2, view->firsts + block + 1, (view->numBlocks - block - 1) * sizeof(int));
+    view->blocks[block + 1] = added;
+    view->firsts[block + 1] = added->distances[0];
+    view->numBlocks++;
+}
+
+void viewStationAdded(viewDomain *views, int distance, int maxAutonomy) {
+    if (!views || views->rebuild) {
+        return;
+    }
+    networkView *view = writableView(views);
+    if (view->numBlocks == 0) {
+        view->blocks[0] = allocateViewBlock(view->version);
+        view->numBlocks = 1;
+    }
+    int index = findViewBlock(view, distance);
+    viewBlock *block = writableBlock(views, view, index);
+    int position = lowerBoundInBlock(block, distance);
+    if (block->count == VIEW_BLOCK_SIZE) {
+        // split in halves, the upper one goes to a new block
+        viewBlock *upper = allocateViewBlock(view->version);
+        int half = VIEW_BLOCK_SIZE / 2;
+        upper->count = VIEW_BLOCK_SIZE - half;
+        memcpy(upper->distances, block->distances + half, upper->count * sizeof(int));
+        memcpy(upper->autonomies, block->autonomies + half, upper->count * sizeof(int));
+        block->count = half;
+        insertViewBlock(&views->next, index, upper);
+        view = views->next;
+        if (position > half) {
+            block = upper;
+            position -= half;
+            index++;
+        }
+    }
+    memmove(block->distances + position + 1, block->distances + position, (block->count - position) * sizeof(int));
+    memmove(block->autonomies + position + 1, block->autonomies + position, (block->count - position) * sizeof(int));
+    block->distances[position] = distance;
+    block->autonomies[position] = maxAutonomy;
+    block->count++;
+    view->firsts[index] = block->distances[0];
+    view->count++;
+    view->checksum += viewPairHash(distance, maxAutonomy);
+}
+
+void viewStationRemoved(viewDomain *views, int distance) {
+    if (!views || views->rebuild) {
+        return;
+    }
+    networkView *view = writableView(views);
+    int index = findViewBlock(view, distance);
+    viewBlock *block = writableBlock(views, view, index);
+    int position = lowerBoundInBlock(block, distance);
+    view->checksum -= viewPairHash(distance, block->autonomies[position]);
+    block->count--;
+    memmove(block->distances + position, block->distances + position + 1, (block->count - position) * sizeof(int));
+    memmove(block->autonomies + position, block->autonomies + position + 1, (block->count - position) * sizeof(int));
+    view->count--;
+    if (block->count > 0) {
+        view->firsts[index] = block->distances[0];
+        return;
+    }
+    // the copy was never published
+    free(block);
+    memmove(view->blocks + index, view->blocks + index + 1, (view->numBlocks - index - 1) * sizeof(viewBlock *));
+    memmove(view->firsts + index, view->firsts + index + 1, (view->numBlocks - index - 1) * sizeof(int));
+    view->numBlocks--;
+}
+
+void viewAutonomyChanged(viewDomain *views, int distance, int maxAutonomy) {
+    if (!views || views->rebuild) {
+        return;
+    }
+    networkView *view = writableView(views);
+    int index = findViewBlock(view, distance);
+    viewBlock *block = writableBlock(views, view, index);
+    int position = lowerBoundInBlock(block, distance);
+    view->checksum += viewPairHash(distance, maxAutonomy) - viewPairHash(distance, block->autonomies[position]);
+    block->autonomies[position] = maxAutonomy;
+}
+
+#if STATION_TABLE
+static inline int stationTableSlot(stationTable *table, int distance) {
+    return (int)(((uint32_t)distance * 0x9E3779B1u) >> table->shift);
+}
+
+station *findInStationTable(stationTable *table, int distance) {
+    if (table->capacity == 0) {
+        return NULL;
+    }
+    int mask = table->capacity - 1;
+    for (int slot = stationTableSlot(table, distance);; slot = (slot + 1) & mask) {
+        if (!table->nodes[slot]) {
+            return NULL;
+        }
+        if (table->distances[slot] == distance) {
+            return linkedStation(table->nodes[slot]);
+        }
+    }
+}
+
+// The distance must not be in the table yet
+static void placeInStationTable(stationTable *table, station *node) {
+    int mask = table->capacity - 1;
+    int slot = stationTableSlot(table, node->distance);
+    while (table->nodes[slot]) {
+        slot = (slot + 1) & mask;
+    }
+    table->distances[slot] = node->distance;
+    table->nodes[slot] = stationLinkOf(node);
+}
+
+// Make room for count stations without going over half full
+void reserveStationTable(stationTable *table, int count) {
+    int capacity = table->capacity ? table->capacity : 1024;
+    while (2 * (long long)count > capacity) {
+        capacity *= 2;
+    }
+    if (capacity == table->capacity) {
+        return;
+    }
+    int *oldDistances = table->distances;
+    stationLink *oldNodes = table->nodes;
+    int oldCapacity = table->capacity;
+    table->capacity = capacity;
+    table->shift = 32 - __builtin_ctz((unsigned)capacity);
+    table->distances = (int *)malloc(capacity * sizeof(int));
+    table->nodes = (stationLink *)calloc(capacity, sizeof(stationLink));
+    for (int i = 0; i < oldCapacity; i++) {
+        if (oldNodes[i]) {
+            placeInStationTable(table, linkedStation(oldNodes[i]));
+        }
+    }
+    free(oldDistances);
+    free(oldNodes);
+}
+
+void addToStationTable(stationTable *table, station *node) {
+    if (2 * (table->count + 1) > table->capacity) {
+        reserveStationTable(table, table->capacity ? table->capacity : 1);
+    }
+    placeInStationTable(table, node);
+    table->count++;
+}
+
+// Removal shifts the rest of the probe run back instead of leaving a
+// tombstone, so lookups of missing distances stay short
+void removeFromStationTable(stationTable *table, int distance) {
+    int mask = table->capacity - 1;
+    int slot = stationTableSlot(table, distance);
+    // the distances of empty slots were never written, look at the node first
+    while (table->nodes[slot] && table->distances[slot] != distance) {
+        slot = (slot + 1) & mask;
+    }
+    if (!table->nodes[slot]) {
+        return;
+    }
+    int hole = slot;
+    for (slot = (hole + 1) & mask; table->nodes[slot]; slot = (slot + 1) & mask) {
+        int home = stationTableSlot(table, table->distances[slot]);
+        // the entry may fill the hole only if its home is not between them
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            table->distances[hole] = table->distances[slot];
+            table->nodes[hole] = table->nodes[slot];
+            hole = slot;
+        }
+    }
+    table->nodes[hole] = stationLinkOf(NULL);
+    table->count--;
+}
+
+void freeStationTable(stationTable *table) {
+    free(table->distances);
+    free(table->nodes);
+    memset(table, 0, sizeof(*table));
+}
+
+void printStationTableStats(stationTable *table, FILE *stream) {
+    size_t bytes = (size_t)table->capacity * (sizeof(int) + sizeof(stationLink));
+    fprintf(stream, "station table: %d stations, %d slots, %zu bytes, %.1f bytes per station\n", table->count,
+            table->capacity, bytes, table->count ? (double)bytes / table->count : 0.0);
+}
+#endif
+
+// Engine independent station index API
+
+station *findStation(stationIndex *index, int distance) {
+#if STATION_TABLE
+    return findInStationTable(&index->table, distance);
+#elif STATION_INDEX == INDEX_BPLUS
+    return findStationInBplus(index, distance);
+#else
+    return findStationInTreeAVL(index->root, distance);
+#endif
+}
+
+// false when a station at the same distance already exists
+bool insertStation(stationIndex *index, station *newStation) {
+#if STATION_TABLE
+    if (findInStationTable(&index->table, newStation->distance)) {
+        return false;
+    }
+#if STATION_INDEX == INDEX_BPLUS
+    insertStationInBplus(index, newStation);
+#else
+    insertNewStationInTree(&index->root, newStation);
+#endif
+    addToStationTable(&index->table, newStation);
+    bool inserted = true;
+#elif STATION_INDEX == INDEX_BPLUS
+    bool inserted = insertStationInBplus(index, newStation);
+#else
+    bool inserted = insertOrUpdateStationInTree(&index->root, newStation);
+#endif
+    if (inserted) {
+        invalidatePathCache(index->cache, newStation->distance);
+        markRoutesReplan(index->routes, newStation->distance);
+        reachStationAdded(index->reach, newStation->distance, newStation->maxAutonomy);
+        markReadIndexStale(index->sorted);
+        viewStationAdded(index->views, newStation->distance, newStation->maxAutonomy);
+    }
+    return inserted;
+}
+
+// Take the station at distance out of the index and return it, NULL if missing
+station *detachStation(stationIndex *index, int distance) {
+#if STATION_TABLE
+    if (!findInStationTable(&index->table, distance)) {
+        return NULL;
+    }
+    removeFromStationTable(&index->table, distance);
+#endif
+#if STATION_INDEX == INDEX_BPLUS
+    station *removed = removeStationFromBplus(index, distance);
+#else
+    station *removed = NULL;
+    index->root = removeStationFromTreeAVL(index->root, distance, &removed);
+#endif
+    if (removed) {
+        invalidatePathCache(index->cache, distance);
+        markRoutesReplan(index->routes, distance);
+        reachStationRemoved(index->reach, distance);
+        markReadIndexStale(index->sorted);
+        viewStationRemoved(index->views, distance);
+    }
+    return removed;
+}
+
+// Fill an empty index with stations sorted by strictly increasing distance.
+// Nothing can depend on the stations yet, so there is nothing to invalidate
+// but the copies of the stations: the reach index, the read index and the
+// concurrent readers' view, which are built again from scratch.
+void buildStationIndex(stationIndex *index, station **sorted, int count) {
+#if STATION_INDEX == INDEX_BPLUS
+    buildBplus(index, sorted, count);
+#else
+    index->root = buildTreeAVL(sorted, 0, count, NULL);
+#endif
+#if STATION_TABLE
+    reserveStationTable(&index->table, count);
+    for (int i = 0; i < count; i++) {
+        addToStationTable(&index->table, sorted[i]);
+    }
+#endif
+    markReachIndexStale(index->reach);
+    markReadIndexStale(index->sorted);
+    if (index->views) {
+        index->views->rebuild = true;
+        __atomic_store_n(&index->views->pending, true, __ATOMIC_RELEASE);
+    }
+}
+
+station *firstStation(stationIndex *index) {
+#if STATION_INDEX == INDEX_BPLUS
+    return index->first ? index->first->stations[0] : NULL;
+#else
+    return minValueNode(index->root);
+#endif
+}
+
+// Replace the view wholesale with the stations of the index
+static void buildViewFromStations(stationIndex *index) {
+    viewDomain *views = index->views;
+    networkView *published = views->published;
+    unsigned int version = published ? published->version + 1 : 1;
+    if (views->next) {
+        for (int i = 0; i < views->next->numBlocks; i++) {
+            if (views->next->blocks[i]->version == version) {
+                free(views->next->blocks[i]);
+            }
+        }
+        free(views->next);
+    }
+    // every block of the published view goes, the replaced ones included
+    views->numReplaced = 0;
+    for (int i = 0; published && i < published->numBlocks; i++) {
+        addToReplaced(views, published->blocks[i]);
+    }
+
+    int count = 0;
+    for (station *node = firstStation(index); node != NULL; node = getSuccessor(node)) {
+        count++;
+    }
+    networkView *view = allocateView((count + VIEW_BLOCK_SIZE - 1) / VIEW_BLOCK_SIZE + 16);
+    view->version = version;
+    view->count = count;
+    view->numBlocks = 0;
+    view->checksum = 0;
+    viewBlock *block = NULL;
+    for (station *node = firstStation(index); node != NULL; node = getSuccessor(node)) {
+        if (!block || block->count == VIEW_BLOCK_SIZE) {
+            block = allocateViewBlock(version);
+            view->blocks[view->numBlocks] = block;
+            view->firsts[view->numBlocks] = node->distance;
+            view->numBlocks++;
+        }
+        block->distances[block->count] = node->distance;
+        block->autonomies[block->count] = node->maxAutonomy;
+        block->count++;
+        view->checksum += viewPairHash(node->distance, node->maxAutonomy);
+    }
+    views->next = view;
+    views->rebuild = false;
+}
+
+static void retireMemory(viewDomain *views, void *memory, unsigned long long epoch) {
+    if (views->numRetired == views->retiredCapacity) {
+        views->retiredCapacity = views->retiredCapacity ? views->retiredCapacity * 2 : 64;
+        views->retired = (retiredMemory *)realloc(views->retired, views->retiredCapacity * sizeof(retiredMemory));
+    }
+    views->retired[views->numRetired].memory = memory;
+    views->retired[views->numRetired].epoch = epoch;
+    views->numRetired++;
+    views->retiredCount++;
+}
+
+// Free what was retired before the oldest epoch a reader is still in
+void reclaimViews(viewDomain *views) {
+    unsigned long long oldest = VIEW_IDLE;
+    for (int i = 0; i < MAX_VIEW_READERS; i++) {
+        unsigned long long epoch = __atomic_load_n(&views->readers[i].epoch, __ATOMIC_SEQ_CST);
+        if (epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    int kept = 0;
+    for (int i = 0; i < views->numRetired; i++) {
+        if (views->retired[i].epoch < oldest) {
+            free(views->retired[i].memory);
+            views->reclaimedCount++;
+        } else {
+            views->retired[kept++] = views->retired[i];
+        }
+    }
+    views->numRetired = kept;
+}
+
+// Writer: make the changes so far visible to the readers
+void publishView(stationIndex *index) {
+    viewDomain *views = index->views;
+    if (views->rebuild) {
+        buildViewFromStations(index);
+    }
+    if (!views->next) {
+        return;
+    }
+    networkView *old = views->published;
+    __atomic_store_n(&views->published, views->next, __ATOMIC_SEQ_CST);
+    views->next = NULL;
+    __atomic_store_n(&views->pending, false, __ATOMIC_RELEASE);
+    // readers that can still see old announced this epoch or an earlier one
+    unsigned long long epoch = __atomic_fetch_add(&views->epoch, 1, __ATOMIC_SEQ_CST);
+    if (old) {
+        retireMemory(views, old, epoch);
+    }
+    for (int i = 0; i < views->numReplaced; i++) {
+        retireMemory(views, views->replaced[i], epoch);
+    }
+    views->numReplaced = 0;
+    views->publications++;
+    reclaimViews(views);
+}
+
+// Reader slots: a thread claims one for as long as it reads views
+int claimViewReader(viewDomain *views) {
+    for (int i = 0; i < MAX_VIEW_READERS; i++) {
+        bool expected = false;
+        if (__atomic_compare_exchange_n(&views->readers[i].claimed, &expected, true, false, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void releaseViewReader(viewDomain *views, int reader) {
+    if (reader >= 0) {
+        __atomic_store_n(&views->readers[reader].claimed, false, __ATOMIC_RELEASE);
+    }
+}
+
+// The published view, which stays valid until leaveView. A thread without a
+// reader slot may only read while it holds the writer side.
+const networkView *enterView(viewDomain *views, int reader) {
+    if (reader >= 0) {
+        unsigned long long epoch = __atomic_load_n(&views->epoch, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&views->readers[reader].epoch, epoch, __ATOMIC_SEQ_CST);
+    }
+    return __atomic_load_n(&views->published, __ATOMIC_SEQ_CST);
+}
+
+void leaveView(viewDomain *views, int reader) {
+    if (reader >= 0) {
+        __atomic_store_n(&views->readers[reader].epoch, VIEW_IDLE, __ATOMIC_RELEASE);
+    }
+}
+
+void freeViewDomain(viewDomain *views) {
+    if (!views) {
+        return;
+    }
+    for (int i = 0; i < views->numRetired; i++) {
+        free(views->retired[i].memory);
+    }
+    // the blocks in use are those of next, or of the published view when
+    // nothing changed, plus the published ones next replaced
+    networkView *current = views->next ? views->next : views->published;
+    for (int i = 0; current && i < current->numBlocks; i++) {
+        free(current->blocks[i]);
+    }
+    for (int i = 0; i < views->numReplaced; i++) {
+        free(views->replaced[i]);
+    }
+    free(views->next);
+    free(views->published);
+    free(views->replaced);
+    free(views->retired);
+    free(views);
+}
+
+void printViewStats(viewDomain *views, FILE *stream) {
+    networkView *view = views->published;
+    fprintf(stream, "views: %lld publications, %lld blocks copied, %lld retired, %lld reclaimed, %d stations in %d blocks\n",
+            views->publications, views->blocksCopied, views->retiredCount, views->reclaimedCount, view ? view->count : 0,
+            view ? view->numBlocks : 0);
+}
+
+void setMaxAutonomy(stationIndex *index, station *node, int maxAutonomy) {
+    if (node->maxAutonomy == maxAutonomy) {
+        return;
+    }
+    invalidatePathCache(index->cache, node->distance);
+    markRoutesChanged(index->routes, node);
+    updateReachIndex(index->reach, node, maxAutonomy);
+    updateReadIndex(index->sorted, node->distance, maxAutonomy);
+    viewAutonomyChanged(index->views, node->distance, maxAutonomy);
+    node->maxAutonomy = maxAutonomy;
+#if STATION_INDEX == INDEX_BPLUS
+    node->leaf->maxAutonomies[node->slot] = maxAutonomy;
+#endif
+#if PATH_PLANNER == PLANNER_FRONTIER
+    for (station *ancestor = node; ancestor != NULL; ancestor = parentOf(ancestor)) {
+        updateReachBounds(ancestor);
+    }
+#endif
+}
+
+void freeLoadedSnapshot(struct loadedSnapshot *loaded);
+
+void freeStationIndex(stationIndex *index) {
+#if USE_SLAB_ALLOCATOR
+    // every station, car pool and index node lives in a slab, drop them all at once
+#if !COMPACT_STATIONS
+    slabRelease(&stationSlab);
+#endif
+    slabRelease(&carPoolSlab);
+    for (int i = 0; i < CAR_POOL_SIZE_CLASSES; i++) {
+        slabRelease(&carEntrySlabs[i]);
+    }
+#if STATION_INDEX == INDEX_BPLUS
+    slabRelease(&bplusLeafSlab);
+    slabRelease(&bplusInnerSlab);
+#endif
+#elif STATION_INDEX == INDEX_BPLUS
+    if (index->root) {
+        freeBplusNodes(index->root, index->height);
+    }
+#else
+    freeTree(index->root);
+#endif
+#if COMPACT_STATIONS
+    releaseCompactPools();
+#endif
+#if PATH_CACHE_SIZE > 0
+    freePathCache(index->cache);
+#endif
+    freeStandingRoutes(index->routes);
+    freeReachIndex(index->reach);
+    freeReadIndex(index->sorted);
+    freeViewDomain(index->views);
+    freeLoadedSnapshot(index->loaded);
+#if STATION_TABLE
+    freeStationTable(&index->table);
+#endif
+    memset(index, 0, sizeof(*index));
+    freeStationIds();
+}
+
+// --memory-stats: what the stations take, per station. Live bytes are the
+// objects in use, held bytes what their slabs and pools took from the system,
+// free lists and untouched parts of blocks included. The path cache, the hop
+// count tables and the planner scratch are not per station and are left out.
+void printMemoryStats(stationIndex *index, FILE *stream) {
+    long long stations = stationIds.next - stationIds.numReleased;
+    double perStation = stations > 0 ? 1.0 / stations : 0.0;
+#if COMPACT_STATIONS
+    // every slot below next has been touched, demolished ones wait for reuse
+    size_t nodesLive = (size_t)stations * sizeof(station);
+    size_t poolsLive = (size_t)stations * sizeof(carList);
+    size_t nodesHeld = (size_t)stationIds.next * sizeof(station);
+    size_t poolsHeld = (size_t)stationIds.next * sizeof(carList);
+#else
+    size_t nodesLive = (size_t)stationSlab.live * stationSlab.objectSize;
+    size_t poolsLive = (size_t)carPoolSlab.live * carPoolSlab.objectSize;
+    size_t nodesHeld = slabHeldBytes(&stationSlab);
+    size_t poolsHeld = slabHeldBytes(&carPoolSlab);
+#endif
+    size_t entriesLive = 0;
+    size_t entriesHeld = 0;
+    for (int i = 0; i < CAR_POOL_SIZE_CLASSES; i++) {
+        entriesLive += (size_t)carEntrySlabs[i].live * carEntrySlabs[i].objectSize;
+        entriesHeld += slabHeldBytes(&carEntrySlabs[i]);
+    }
+    size_t indexLive = 0;
+    size_t indexHeld = 0;
+#if STATION_INDEX == INDEX_BPLUS
+    indexLive = (size_t)bplusLeafSlab.live * bplusLeafSlab.objectSize + (size_t)bplusInnerSlab.live * bplusInnerSlab.objectSize;
+    indexHeld = slabHeldBytes(&bplusLeafSlab) + slabHeldBytes(&bplusInnerSlab);
+#endif
+#if STATION_TABLE
+    size_t table = (size_t)index->table.capacity * (sizeof(int) + sizeof(stationLink));
+#else
+    size_t table = 0;
+#endif
+    size_t sorted = 0;
+    if (index->sorted) {
+        sorted = (size_t)index->sorted->capacity * 2 * sizeof(int) + (index->sorted->capacity + 1) * sizeof(eytzingerEntry);
+    }
+    size_t live = nodesLive + poolsLive + entriesLive + indexLive + table + sorted;
+    size_t held = nodesHeld + poolsHeld + entriesHeld + indexHeld + table + sorted;
+    fprintf(stream, "memory: %lld stations, %.1f bytes per station live, %.1f held (%zu bytes)\n", stations,
+            live * perStation, held * perStation, held);
+    fprintf(stream,
+            "memory per station: nodes %.1f (%zu each), car pools %.1f (%zu each), car entries %.1f, index nodes %.1f, "
+            "table %.1f, read index %.1f\n",
+            nodesLive * perStation, sizeof(station), poolsLive * perStation, sizeof(carList), entriesLive * perStation,
+            indexLive * perStation, table * perStation, sorted * perStation);
+}
+
+// A station that is not in the index yet, NULL when out of memory
+station *createStation(int dist, int numCars, int *cars) {
+#if COMPACT_STATIONS
+    station *newStation = allocateCompactStation();
+#else
+    station *newStation = (station *)slabAlloc(&stationSlab);
+#endif
+    if (!newStation) {
+        return NULL;
+    }
+
+    newStation->distance = dist;
+    // newStation->reachable = NULL;
+#if !COMPACT_STATIONS
+    newStation->carPool = createCarPool();  // Initialize the car list to NULL
+    newStation->id = acquireStationId();
+#endif
+    // newStation->numCars = 0;                // Initialize the number of cars to 0
+    newStation->maxAutonomy = 0;  // Initialize max autonomy to 0
+    // newStation->deleted = false;
+
+    fillCarPool(stationCars(newStation), numCars, cars);
+    newStation->maxAutonomy = getMaxAutonomy(stationCars(newStation));
+    return newStation;
+}
+
+char *addStation(stationIndex *index, int dist, int numCars, int *cars) {
+    if (numCars > MAX_AUTO) {
+        return "non aggiunta\n";
+    }
+
+    station *newStation = createStation(dist, numCars, cars);
+    if (!newStation) {
+        return "memory allocation error\n";
+    }
+
+    if (insertStation(index, newStation)) {
+        return "aggiunta\n";
+    } else {
+        // freeCarList(&newStation->cars);
+        destroyStation(newStation);
+        return "non aggiunta\n";
+    }
+}
+
+char *demolishStation(stationIndex *index, int distance) {
+    station *removed = detachStation(index, distance);
+    if (!removed) {
+        return "non demolita\n";
+    }
+    destroyStation(removed);
+    return "demolita\n";
+}
+
+char *addCar(stationIndex *index, int distance, int carAutonomy) {
+    station *current = findStation(index, distance);
+    if (!current) {
+        return "non aggiunta\n";
+    }
+    if (insertCarInPool(stationCars(current), carAutonomy)) {
+        if (carAutonomy > current->maxAutonomy) {
+            setMaxAutonomy(index, current, carAutonomy);
+        }
+        return "aggiunta\n";
+    } else {
+        return "non aggiunta\n";
+    }
+}
+
+char *removeCar(stationIndex *index, int distance, int carAutonomy) {
+    station *current = findStation(index, distance);
+    if (!current) {
+        return "non rottamata\n";
+    }
+
+    bool removed = removeCarFromPool(stationCars(current), carAutonomy);
+    setMaxAutonomy(index, current, getMaxAutonomy(stationCars(current)));
+
+    if (removed)
+        return "rottamata\n";
+    else
+        return "non rottamata\n";
+}
+
+// The queue is a 4-ary min-heap of inline entries and every queued station
+// knows its slot, so a better label moves the entry up instead of queueing
+// the station again. Order: steps, then minWeight, then distance; the first
+// two share a 64-bit key, there is no room left for the distance next to
+// them so it is kept beside the key and only read on ties.
+static inline uint64_t queueKey(plannerState *state) {
+    return ((uint64_t)(uint32_t)state->steps << 32) | ((uint32_t)state->minWeight ^ 0x80000000u);
+}
+
+static inline bool queueEntryBefore(queueEntry *a, queueEntry *b) {
+    return a->key < b->key || (a->key == b->key && a->distance < b->distance);
+}
+
+static inline void placeInQueue(plannerScratch *scratch, int slot, queueEntry entry) {
+    scratch->queue.heapArray[slot] = entry;
+    scratch->states[stationId(entry.node)].heapSlot = slot;
+}
+
+void heapifyUp(plannerScratch *scratch, int index) {
+    PriorityQueue *pq = &scratch->queue;
+    queueEntry entry = pq->heapArray[index];
+    while (index > 0) {
+        int parentIndex = (index - 1) / 4;
+        if (!queueEntryBefore(&entry, &pq->heapArray[parentIndex])) {
+            break;
+        }
+        placeInQueue(scratch, index, pq->heapArray[parentIndex]);
+        index = parentIndex;
+    }
+    placeInQueue(scratch, index, entry);
+}
+
+void heapifyDown(plannerScratch *scratch, int index) {
+    PriorityQueue *pq = &scratch->queue;
+    queueEntry entry = pq->heapArray[index];
+    while (1) {
+        int firstChild = 4 * index + 1;
+        if (firstChild >= pq->size) {
+            break;
+        }
+        int lastChild = firstChild + 4 < pq->size ? firstChild + 4 : pq->size;
+        int smallest = firstChild;
+        for (int child = firstChild + 1; child < lastChild; child++) {
+            if (queueEntryBefore(&pq->heapArray[child], &pq->heapArray[smallest])) {
+                smallest = child;
+            }
+        }
+        if (!queueEntryBefore(&pq->heapArray[smallest], &entry)) {
+            break;
+        }
+        placeInQueue(scratch, index, pq->heapArray[smallest]);
+        index = smallest;
+    }
+    placeInQueue(scratch, index, entry);
+}
+
+// Queue node with its current label, or move it up if it is already queued:
+// labels only ever improve while a station waits
+void insertInQueue(plannerScratch *scratch, station *node) {
+    PriorityQueue *pq = &scratch->queue;
+    plannerState *state = &scratch->states[stationId(node)];
+    if (state->heapSlot >= 0) {
+        COUNT(heapDecreases);
+        pq->heapArray[state->heapSlot].key = queueKey(state);
+        heapifyUp(scratch, state->heapSlot);
+        return;
+    }
+    if (pq->size == pq->capacity) {
+        pq->capacity = pq->capacity ? pq->capacity * 2 : 1024;
+        pq->heapArray = (queueEntry *)realloc(pq->heapArray, pq->capacity * sizeof(queueEntry));
+    }
+    COUNT(heapPushes);
+    queueEntry entry = {queueKey(state), node->distance, node};
+    pq->heapArray[pq->size] = entry;
+    pq->size++;
+    heapifyUp(scratch, pq->size - 1);
+}
+
+station *pop(plannerScratch *scratch) {
+    PriorityQueue *pq = &scratch->queue;
+    if (pq->size == 0) {
+        return NULL;
+    }
+
+    COUNT(heapPops);
+    station *minNode = pq->heapArray[0].node;
+    scratch->states[stationId(minNode)].heapSlot = -1;
+    pq->size--;
+    if (pq->size > 0) {
+        pq->heapArray[0] = pq->heapArray[pq->size];
+        heapifyDown(scratch, 0);
+    }
+    return minNode;
+}
+
+void insertReachableStationsInQueue(plannerScratch *scratch, station *toCheckStation, bool *found, int start, int finish, bool firstInsert, station **currentBiggest, station **currentLowest) {
+    if (toCheckStation->distance == finish) {
+        *found = true;
+    }
+
+    plannerState *checkState = getPlannerState(scratch, toCheckStation);
+    checkState->visited = true;
+    COUNT(stationsVisited);
+
+    if (!(*found)) {
+        station *temp = NULL;
+        if (start < finish)
+            temp = getSuccessor(*currentBiggest);
+        else
+            temp = getPredecessor(*currentLowest);
+
+        while (temp && abs(temp->distance - toCheckStation->distance) <= toCheckStation->maxAutonomy) {
+            plannerState *tempState = getPlannerState(scratch, temp);
+            if (!tempState->visited) {
+                if (firstInsert) {
+                    tempState->steps = checkState->steps + 1;
+                    tempState->minWeight = temp->distance;
+                    tempState->pathPrevious = stationLinkOf(toCheckStation);
+
+                    insertInQueue(scratch, temp);
+                } else {
+                    int checkValue = 0;
+                    if (temp->distance != finish)
+                        checkValue = (checkState->minWeight < temp->distance) ? checkState->minWeight : temp->distance;
+                    else
+                        checkValue = checkState->minWeight;
+
+                    if (tempState->steps > checkState->steps + 1) {
+                        tempState->steps = checkState->steps + 1;
+                        tempState->minWeight = checkValue;
+                        tempState->pathPrevious = stationLinkOf(toCheckStation);
+
+                        insertInQueue(scratch, temp);
+
+                    } else if (tempState->steps == checkState->steps + 1) {
+                        if (tempState->minWeight > checkValue) {
+                            tempState->steps = checkState->steps + 1;
+                            tempState->minWeight = checkValue;
+                            tempState->pathPrevious = stationLinkOf(toCheckStation);
+
+                            insertInQueue(scratch, temp);
+
+                        } else if (tempState->minWeight == checkValue && linkedStation(tempState->pathPrevious)->distance > toCheckStation->distance) {
+                            tempState->steps = checkState->steps + 1;
+                            tempState->minWeight = checkValue;
+                            tempState->pathPrevious = stationLinkOf(toCheckStation);
+
+                            insertInQueue(scratch, temp);
+                        }
+                    }
+                }
+            }
+
+            if ((*currentBiggest)->distance < temp->distance)
+                *currentBiggest = temp;
+            if ((*currentLowest)->distance > temp->distance)
+                *currentLowest = temp;
+
+            if (start < finish)
+                temp = getSuccessor(*currentBiggest);
+            else
+                temp = getPredecessor(*currentLowest);
+        }
+    }
+}
+
+void findPathHelper(plannerScratch *scratch, station *startStation, bool *found, int start, int finish) {
+    station *currentBiggest = startStation;
+    station *currentLowest = startStation;
+    // check start station and insert in queue the reachable stations
+    insertReachableStationsInQueue(scratch, startStation, found, start, finish, true, &currentBiggest, &currentLowest);
+
+    // pop stations from queue and check them
+    while (scratch->queue.size != 0) {
+        station *toCheckStation = pop(scratch);
+        if (toCheckStation) {
+
+            // printf("biggest: %d lowest: %d\n", currentBiggest->distance, currentLowest->distance);
+            insertReachableStationsInQueue(scratch, toCheckStation, found, start, finish, false, &currentBiggest, &currentLowest);
+        }
+    }
+}
+
+void printPath3(plannerScratch *scratch, station *startStation, station *finishStation, int finish, outputBuffer *out) {
+    if (finishStation->distance == startStation->distance) {
+        appendInt(out, startStation->distance);
+        appendChar(out, ' ');
+        return;
+    }
+    printPath3(scratch, startStation, linkedStation(scratch->states[stationId(finishStation)].pathPrevious), finish, out);
+    appendInt(out, finishStation->distance);
+    if (finishStation->distance != finish) {
+        appendChar(out, ' ');
+    } else {
+        appendChar(out, '\n');
+    }
+}
+
+// Layered sweep planner. Reachability from a station is an interval of the
+// ordered stations, so the hop layers of the search are consecutive runs of
+// stations and every station is discovered exactly once, by the first station
+// of the previous layer that reaches it. The Dijkstra search pops a layer in
+// increasing distance order in both directions (going forward minWeight grows
+// with the distance, going backward it is the distance itself), so the sweep
+// visits each layer in that same order and picks exactly the same previous
+// stations, in O(stations between start and finish) and without a heap.
+
+static inline void appendSweepEntry(plannerScratch *scratch, station *node, int previous) {
+    if (scratch->count == scratch->capacity) {
+        scratch->capacity = scratch->capacity ? scratch->capacity * 2 : 1024;
+        scratch->entries = (sweepEntry *)realloc(scratch->entries, scratch->capacity * sizeof(sweepEntry));
+    }
+    scratch->entries[scratch->count].node = node;
+    scratch->entries[scratch->count].previous = previous;
+    scratch->entries[scratch->count].layer = previous == -1 ? 0 : scratch->entries[previous].layer + 1;
+    scratch->count++;
+    COUNT(stationsVisited);
+}
+
+// First entry with a layer not below the given one
+static int firstEntryOfLayer(plannerScratch *scratch, int layer) {
+    int low = 0;
+    int high = scratch->count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (scratch->entries[middle].layer < layer) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Process the entries from `from` on until finish is discovered, return the
+// entry of finish or -1 when it cannot be reached. Everything discovered
+// before `from` is processed must already be in scratch->entries.
+int continueSweep(plannerScratch *scratch, int finish, int from) {
+    if (scratch->entries[0].node->distance < finish) {
+        // forward the layers are visited left to right, so one pass suffices
+        station *next = getSuccessor(scratch->entries[scratch->count - 1].node);
+        for (int i = from; i < scratch->count; i++) {
+            station *current = scratch->entries[i].node;
+            while (next && abs(next->distance - current->distance) <= current->maxAutonomy) {
+                appendSweepEntry(scratch, next, i);
+                if (next->distance == finish) {
+                    return scratch->count - 1;
+                }
+                next = getSuccessor(next);
+            }
+        }
+    } else {
+        // backward each layer is discovered right to left but visited left to right
+        station *next = getPredecessor(scratch->entries[scratch->count - 1].node);
+        int layer = scratch->entries[from].layer;
+        int layerStart = firstEntryOfLayer(scratch, layer);
+        int layerEnd = firstEntryOfLayer(scratch, layer + 1);
+        int i = from;
+        while (layerStart < layerEnd) {
+            for (; i >= layerStart; i--) {
+                station *current = scratch->entries[i].node;
+                while (next && abs(next->distance - current->distance) <= current->maxAutonomy) {
+                    appendSweepEntry(scratch, next, i);
+                    if (next->distance == finish) {
+                        return scratch->count - 1;
+                    }
+                    next = getPredecessor(next);
+                }
+            }
+            layerStart = layerEnd;
+            layerEnd = scratch->count;
+            i = layerEnd - 1;
+        }
+    }
+    return -1;
+}
+
+// Fill scratch->entries from startStation until finish is discovered, return
+// the entry of finish or -1 when it cannot be reached
+int sweepLayers(station *startStation, int finish, plannerScratch *scratch) {
+    scratch->count = 0;
+    appendSweepEntry(scratch, startStation, -1);
+    return continueSweep(scratch, finish, 0);
+}
+
+// Turn the chain of previous links that starts at entry round, return the
+// entry it starts from now
+static int reverseSweepLinks(plannerScratch *scratch, int entry) {
+    int next = -1;
+    for (int i = entry; i != -1;) {
+        int previous = scratch->entries[i].previous;
+        scratch->entries[i].previous = next;
+        next = i;
+        i = previous;
+    }
+    return next;
+}
+
+// Same text as printPath3: the stops from start to finish, then a newline.
+// The path is left linked from start to finish.
+void printSweepPath(plannerScratch *scratch, int finishEntry, outputBuffer *out) {
+    int next = reverseSweepLinks(scratch, finishEntry);
+    for (int i = next; i != -1; i = scratch->entries[i].previous) {
+        appendInt(out, scratch->entries[i].node->distance);
+        appendChar(out, scratch->entries[i].previous == -1 ? '\n' : ' ');
+    }
+}
+
+#if READ_INDEX
+// Lay sorted positions [i, count) out in BFS order from node k on, return
+// the first position left
+static int fillEytzinger(readIndex *sorted, int i, unsigned int k) {
+    if (k <= (unsigned int)sorted->count) {
+        i = fillEytzinger(sorted, i, 2 * k);
+        sorted->tree[k].distance = sorted->distances[i];
+        sorted->tree[k].position = i;
+        i = fillEytzinger(sorted, i + 1, 2 * k + 1);
+    }
+    return i;
+}
+
+void buildReadIndex(stationIndex *index) {
+    long long started = nowNanos();
+    readIndex *sorted = index->sorted;
+    int count = stationIds.next - stationIds.numReleased;
+    if (count > sorted->capacity) {
+        sorted->capacity = count;
+        sorted->distances = (int *)realloc(sorted->distances, count * sizeof(int));
+        sorted->autonomies = (int *)realloc(sorted->autonomies, count * sizeof(int));
+        sorted->tree = (eytzingerEntry *)realloc(sorted->tree, (count + 1) * sizeof(eytzingerEntry));
+    }
+    int i = 0;
+    for (station *node = firstStation(index); node; node = getSuccessor(node), i++) {
+        sorted->distances[i] = node->distance;
+        sorted->autonomies[i] = node->maxAutonomy;
+    }
+    sorted->count = i;
+    if (!sorted->tree) {
+        sorted->tree = (eytzingerEntry *)malloc(sizeof(eytzingerEntry));
+    }
+    fillEytzinger(sorted, 0, 1);
+    sorted->stale = false;
+    sorted->treeWork = 0;
+    sorted->indexWork = 0;
+    sorted->builds++;
+    sorted->builtStations += i;
+    sorted->buildNanos += nowNanos() - started;
+}
+
+static inline void appendIndexEntries(plannerScratch *scratch, int previous, int amount) {
+    if (scratch->count + amount > scratch->capacity) {
+        int capacity = scratch->capacity ? scratch->capacity : 1024;
+        while (capacity < scratch->count + amount) {
+            capacity *= 2;
+        }
+        scratch->capacity = capacity;
+        scratch->entries = (sweepEntry *)realloc(scratch->entries, capacity * sizeof(sweepEntry));
+    }
+    int layer = previous == -1 ? 0 : scratch->entries[previous].layer + 1;
+    sweepEntry *entry = scratch->entries + scratch->count;
+    for (int e = 0; e < amount; e++) {
+        entry[e].node = NULL;
+        entry[e].previous = previous;
+        entry[e].layer = layer;
+    }
+    scratch->count += amount;
+    COUNT_BY(stationsVisited, amount);
+}
+
+// sweepLayers on the arrays from the start station at position. The sweep
+// takes the stations in a row, so entry e is the station at position + e
+// going forward and at position - e going backward; the stations a sweep
+// entry reaches are a run of the array that ends where the scan kernel
+// finds the first distance out of reach. Most entries reach no new station,
+// those skip the kernel call. Entry of finishPosition or -1.
+static int sweepReadIndex(const readIndex *sorted, int position, int finishPosition, plannerScratch *scratch) {
+    const int *distances = sorted->distances;
+    const int *autonomies = sorted->autonomies;
+    scratch->count = 0;
+    appendIndexEntries(scratch, -1, 1);
+    if (position < finishPosition) {
+        int next = position + 1;
+        for (int i = 0; i < scratch->count; i++) {
+            long long reach = (long long)distances[position + i] + autonomies[position + i];
+            if (next == sorted->count || distances[next] > reach) {
+                continue;
+            }
+            int end = kernels.scanAbove(distances, next + 1, sorted->count, reach > INT_MAX ? INT_MAX : (int)reach);
+            if (end > finishPosition) {
+                appendIndexEntries(scratch, i, finishPosition + 1 - next);
+                return scratch->count - 1;
+            }
+            appendIndexEntries(scratch, i, end - next);
+            next = end;
+        }
+    } else {
+        int next = position - 1;
+        int layerStart = 0;
+        int layerEnd = 1;
+        int i = 0;
+        while (layerStart < layerEnd) {
+            for (; i >= layerStart; i--) {
+                long long reach = (long long)distances[position - i] - autonomies[position - i];
+                if (next < 0 || distances[next] < reach) {
+                    continue;
+                }
+                int end = kernels.scanBelow(distances, next - 1, 0, reach < INT_MIN ? INT_MIN : (int)reach);
+                if (end < finishPosition) {
+                    appendIndexEntries(scratch, i, next + 1 - finishPosition);
+                    return scratch->count - 1;
+                }
+                appendIndexEntries(scratch, i, next - end);
+                next = end;
+            }
+            layerStart = layerEnd;
+            layerEnd = scratch->count;
+            i = layerEnd - 1;
+        }
+    }
+    return -1;
+}
+
+// planPath on a fresh read index
+void planOnReadIndex(const readIndex *sorted, int start, int finish, plannerScratch *scratch, outputBuffer *out) {
+    int startPosition = findInReadIndex(sorted, start);
+    int finishPosition = findInReadIndex(sorted, finish);
+    if (startPosition == -1 || finishPosition == -1) {
+        appendString(out, "nessun percorso\n");
+        return;
+    }
+    if (abs(start - finish) <= sorted->autonomies[startPosition]) {
+        appendDirectPath(out, start, finish);
+        return;
+    }
+    int finishEntry = sweepReadIndex(sorted, startPosition, finishPosition, scratch);
+    scratch->swept += scratch->count;
+    if (finishEntry == -1) {
+        appendString(out, "nessun percorso\n");
+        return;
+    }
+    int step = start < finish ? 1 : -1;
+    int next = reverseSweepLinks(scratch, finishEntry);
+    for (int i = next; i != -1; i = scratch->entries[i].previous) {
+        appendInt(out, sorted->distances[startPosition + step * i]);
+        appendChar(out, scratch->entries[i].previous == -1 ? '\n' : ' ');
+    }
+}
+
+void printReadIndexStats(readIndex *sorted, FILE *stream) {
+    if (!sorted) {
+        fprintf(stream, "read index: never built\n");
+        return;
+    }
+    fprintf(stream,
+            "read index: %lld builds of %lld stations in %.3f ms (%.1f ns per station), %lld queries on the index, "
+            "%lld on the tree, patience %d\n",
+            sorted->builds, sorted->builtStations, sorted->buildNanos / 1e6,
+            sorted->builtStations ? (double)sorted->buildNanos / sorted->builtStations : 0.0, sorted->indexQueries,
+            sorted->treeQueries, sorted->patience);
+}
+#endif
+
+#if PATH_PLANNER == PLANNER_FRONTIER
+// Frontier planner. The stations reached within h hops are the ones between
+// start and a bound that only depends on h, and the next bound is the widest
+// reach among them, which the subtree reach bounds of the AVL give in
+// O(log n) without visiting the stations. Once finish is inside a bound the
+// route is rebuilt from finish back: the sweep's choice of previous station
+// is the lowest distance station of the previous layer that reaches the
+// current one, again a single descent. A query costs O(hops * log n).
+
+// Widest forward reach of the stations of the subtree at distance >= low
+static int reachRightFrom(station *node, int low) {
+    int reach = INT_MIN;
+    while (node) {
+        COUNT(stationsVisited);
+        if (node->distance >= low) {
+            int own = ownReachRight(node);
+            if (own > reach) {
+                reach = own;
+            }
+            if (rightOf(node) && rightOf(node)->reachRight > reach) {
+                reach = rightOf(node)->reachRight;
+            }
+            node = leftOf(node);
+        } else {
+            node = rightOf(node);
+        }
+    }
+    return reach;
+}
+
+static int reachRightUpTo(station *node, int high) {
+    int reach = INT_MIN;
+    while (node) {
+        COUNT(stationsVisited);
+        if (node->distance <= high) {
+            int own = ownReachRight(node);
+            if (own > reach) {
+                reach = own;
+            }
+            if (leftOf(node) && leftOf(node)->reachRight > reach) {
+                reach = leftOf(node)->reachRight;
+            }
+            node = rightOf(node);
+        } else {
+            node = leftOf(node);
+        }
+    }
+    return reach;
+}
+
+// Widest forward reach of the stations with distance in [low, high]
+static int reachRightBetween(station *node, int low, int high) {
+    while (node && (node->distance < low || node->distance > high)) {
+        COUNT(stationsVisited);
+        node = node->distance < low ? rightOf(node) : leftOf(node);
+    }
+    if (!node) {
+        return INT_MIN;
+    }
+    int reach = ownReachRight(node);
+    int fromLeft = reachRightFrom(leftOf(node), low);
+    int fromRight = reachRightUpTo(rightOf(node), high);
+    if (fromLeft > reach) {
+        reach = fromLeft;
+    }
+    if (fromRight > reach) {
+        reach = fromRight;
+    }
+    return reach;
+}
+
+static int reachLeftFrom(station *node, int low) {
+    int reach = INT_MAX;
+    while (node) {
+        COUNT(stationsVisited);
+        if (node->distance >= low) {
+            int own = ownReachLeft(node);
+            if (own < reach) {
+                reach = own;
+            }
+            if (rightOf(node) && rightOf(node)->reachLeft < reach) {
+                reach = rightOf(node)->reachLeft;
+            }
+            node = leftOf(node);
+        } else {
+            node = rightOf(node);
+        }
+    }
+    return reach;
+}
+
+static int reachLeftUpTo(station *node, int high) {
+    int reach = INT_MAX;
+    while (node) {
+        COUNT(stationsVisited);
+        if (node->distance <= high) {
+            int own = ownReachLeft(node);
+            if (own < reach) {
+                reach = own;
+            }
+            if (leftOf(node) && leftOf(node)->reachLeft < reach) {
+                reach = leftOf(node)->reachLeft;
+            }
+            node = rightOf(node);
+        } else {
+            node = leftOf(node);
+        }
+    }
+    return reach;
+}
+
+// Nearest backward reach of the stations with distance in [low, high]
+static int reachLeftBetween(station *node, int low, int high) {
+    while (node && (node->distance < low || node->distance > high)) {
+        COUNT(stationsVisited);
+        node = node->distance < low ? rightOf(node) : leftOf(node);
+    }
+    if (!node) {
+        return INT_MAX;
+    }
+    int reach = ownReachLeft(node);
+    int fromLeft = reachLeftFrom(leftOf(node), low);
+    int fromRight = reachLeftUpTo(rightOf(node), high);
+    if (fromLeft < reach) {
+        reach = fromLeft;
+    }
+    if (fromRight < reach) {
+        reach = fromRight;
+    }
+    return reach;
+}
+
+// Lowest station with distance in [low, high] that reaches target, going
+// forward or backward; subtrees that cannot reach it are skipped whole
+static station *firstReaching(station *node, int low, int high, int target, bool forward) {
+    COUNT(stationsVisited);
+    if (!node || (forward ? node->reachRight < target : node->reachLeft > target)) {
+        return NULL;
+    }
+    if (node->distance < low) {
+        return firstReaching(rightOf(node), low, high, target, forward);
+    }
+    if (node->distance > high) {
+        return firstReaching(leftOf(node), low, high, target, forward);
+    }
+    station *found = firstReaching(leftOf(node), low, high, target, forward);
+    if (found) {
+        return found;
+    }
+    if (forward ? ownReachRight(node) >= target : ownReachLeft(node) <= target) {
+        return node;
+    }
+    return firstReaching(rightOf(node), low, high, target, forward);
+}
+
+static void appendLayerBound(plannerScratch *scratch, int layer, int bound) {
+    if (layer >= scratch->layerCapacity) {
+        scratch->layerCapacity = scratch->layerCapacity ? scratch->layerCapacity * 2 : 256;
+        scratch->layerBounds = (int *)realloc(scratch->layerBounds, scratch->layerCapacity * sizeof(int));
+        scratch->stops = (int *)realloc(scratch->stops, scratch->layerCapacity * sizeof(int));
+    }
+    scratch->layerBounds[layer] = bound;
+}
+
+// Grow the layers from start until finish is inside one, return its layer or
+// -1 when the layers stop growing first
+int expandFrontier(station *root, int start, int finish, plannerScratch *scratch) {
+    int layer = 0;
+    appendLayerBound(scratch, 0, start);
+    if (start < finish) {
+        while (scratch->layerBounds[layer] < finish) {
+            int bound = reachRightBetween(root, start, scratch->layerBounds[layer]);
+            if (bound <= scratch->layerBounds[layer]) {
+                return -1;
+            }
+            appendLayerBound(scratch, ++layer, bound);
+        }
+    } else {
+        while (scratch->layerBounds[layer] > finish) {
+            int bound = reachLeftBetween(root, scratch->layerBounds[layer], start);
+            if (bound >= scratch->layerBounds[layer]) {
+                return -1;
+            }
+            appendLayerBound(scratch, ++layer, bound);
+        }
+    }
+    return layer;
+}
+
+// Pick the previous station of every stop from finish back, then print them
+void printFrontierPath(station *root, int start, int finish, int finishLayer, plannerScratch *scratch, outputBuffer *out) {
+    int *bounds = scratch->layerBounds;
+    bool forward = start < finish;
+    scratch->stops[finishLayer] = finish;
+    for (int layer = finishLayer - 1; layer >= 0; layer--) {
+        // the stations of a layer lie past the bound of the layer before
+        int low = start;
+        int high = start;
+        if (layer > 0) {
+            low = forward ? bounds[layer - 1] + 1 : bounds[layer];
+            high = forward ? bounds[layer] : bounds[layer - 1] - 1;
+        }
+        scratch->stops[layer] = firstReaching(root, low, high, scratch->stops[layer + 1], forward)->distance;
+    }
+    for (int layer = 0; layer <= finishLayer; layer++) {
+        appendInt(out, scratch->stops[layer]);
+        appendChar(out, layer == finishLayer ? '\n' : ' ');
+    }
+}
+#endif
+
+void planPath(stationIndex *index, int start, int finish, plannerScratch *scratch, outputBuffer *out) {
+#if READ_INDEX && PATH_PLANNER == PLANNER_SWEEP
+    readIndex *sorted = index->sorted;
+    if (sorted && !sorted->stale) {
+        planOnReadIndex(sorted, start, finish, scratch, out);
+        return;
+    }
+#endif
+    station *startStation = findStation(index, start);
+    station *finishStation = findStation(index, finish);
+
+    if (startStation == NULL || finishStation == NULL) {
+        appendString(out, "nessun percorso\n");
+        return;
+    }
+    if (abs(start - finish) <= startStation->maxAutonomy) {
+        appendDirectPath(out, start, finish);
+        return;
+    }
+
+#if PATH_PLANNER == PLANNER_SWEEP
+    int finishEntry = sweepLayers(startStation, finish, scratch);
+    scratch->swept += scratch->count;
+    if (finishEntry == -1) {
+        appendString(out, "nessun percorso\n");
+    } else {
+        printSweepPath(scratch, finishEntry, out);
+    }
+#elif PATH_PLANNER == PLANNER_FRONTIER
+    int finishLayer = expandFrontier(index->root, start, finish, scratch);
+    if (finishLayer == -1) {
+        appendString(out, "nessun percorso\n");
+    } else {
+        printFrontierPath(index->root, start, finish, finishLayer, scratch, out);
+    }
+#else
+    bool found = false;
+
+    beginPlannerQuery(scratch);
+    plannerState *startState = getPlannerState(scratch, startStation);
+    startState->minWeight = 0;
+    startState->steps = 0;
+    findPathHelper(scratch, startStation, &found, start, finish);
+    if (!found) {
+        appendString(out, "nessun percorso\n");
+    } else {
+        printPath3(scratch, startStation, finishStation, finish, out);
+    }
+#endif
+}
+
+standingRoute *findStandingRoute(standingRoutes *routes, int start, int finish) {
+    for (int i = 0; i < routes->count; i++) {
+        if (routes->routes[i].start == start && routes->routes[i].finish == finish) {
+            return &routes->routes[i];
+        }
+    }
+    return NULL;
+}
+
+char *registerStandingRoute(stationIndex *index, int start, int finish) {
+    if (!index->routes) {
+        index->routes = (standingRoutes *)calloc(1, sizeof(standingRoutes));
+    }
+    standingRoutes *routes = index->routes;
+    if (findStandingRoute(routes, start, finish)) {
+        return "non registrato\n";
+    }
+    if (routes->count == routes->capacity) {
+        routes->capacity = routes->capacity ? routes->capacity * 2 : 8;
+        routes->routes = (standingRoute *)realloc(routes->routes, routes->capacity * sizeof(standingRoute));
+    }
+    standingRoute *route = &routes->routes[routes->count++];
+    memset(route, 0, sizeof(*route));
+    route->start = start;
+    route->finish = finish;
+    route->replan = true;
+    route->resumeFrom = -1;
+    route->finishEntry = -1;
+    initOutputWithCapacity(&route->text, -1, 64);
+    return "registrato\n";
+}
+
+// Drop what was discovered from route->resumeFrom on and sweep again from
+// there, return how many entries were kept
+static int resumeStandingRoute(standingRoute *route) {
+    plannerScratch *sweep = &route->sweep;
+    sweepEntry *entries = sweep->entries;
+    int from = route->resumeFrom;
+    int cut;
+    if (route->start < route->finish) {
+        // discoveries come in the order of the entries that made them
+        int low = from + 1;
+        int high = sweep->count;
+        while (low < high) {
+            int middle = low + (high - low) / 2;
+            if (entries[middle].previous < from) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        cut = low;
+    } else {
+        // the next layer starts with the discoveries of the entries after from
+        cut = firstEntryOfLayer(sweep, entries[from].layer + 1);
+        while (cut < sweep->count && entries[cut].layer == entries[from].layer + 1 && entries[cut].previous > from) {
+            cut++;
+        }
+    }
+    sweep->count = cut;
+    route->finishEntry = continueSweep(sweep, route->finish, from);
+    return cut;
+}
+
+// Bring the answer of route up to date with the network
+void refreshStandingRoute(stationIndex *index, standingRoute *route) {
+    standingRoutes *routes = index->routes;
+    if (route->replan) {
+        routes->replans++;
+        route->replan = false;
+        route->swept = false;
+        route->finishEntry = -1;
+        route->text.size = 0;
+
+        station *startStation = findStation(index, route->start);
+        station *finishStation = findStation(index, route->finish);
+        if (startStation == NULL || finishStation == NULL) {
+            appendString(&route->text, "nessun percorso\n");
+            route->resumeFrom = -1;
+            return;
+        }
+        if (abs(route->start - route->finish) <= startStation->maxAutonomy) {
+            appendDirectPath(&route->text, route->start, route->finish);
+            route->resumeFrom = -1;
+            return;
+        }
+        route->swept = true;
+        route->finishEntry = sweepLayers(startStation, route->finish, &route->sweep);
+    } else if (route->resumeFrom != -1) {
+        routes->repairs++;
+        routes->resumedEntries += resumeStandingRoute(route);
+    } else {
+        return;
+    }
+    route->resumeFrom = -1;
+
+    route->text.size = 0;
+    if (route->finishEntry == -1) {
+        appendString(&route->text, "nessun percorso\n");
+    } else {
+        printSweepPath(&route->sweep, route->finishEntry, &route->text);
+        // keep the entries linked towards the start for the next repair
+        reverseSweepLinks(&route->sweep, 0);
+    }
+}
+
+void printStandingRouteStats(standingRoutes *routes, FILE *stream) {
+    if (!routes) {
+        fprintf(stream, "standing routes: none\n");
+        return;
+    }
+    fprintf(stream, "standing routes: %d routes, %lld replans, %lld repairs, %lld entries kept by repairs, %lld changes skipped\n",
+            routes->count, routes->replans, routes->repairs, routes->resumedEntries, routes->skipped);
+}
+
+// Answers that need no planning: start == finish, standing routes and
+// cached answers. false when the route has to be planned.
+bool findKnownPath(stationIndex *index, int start, int finish, outputBuffer *out) {
+    if (start == finish) {
+        appendInt(out, start);
+        appendChar(out, '\n');
+        return true;
+    }
+    if (index->routes) {
+        standingRoute *route = findStandingRoute(index->routes, start, finish);
+        if (route) {
+            refreshStandingRoute(index, route);
+            appendText(out, route->text.data, route->text.size);
+            return true;
+        }
+    }
+#if PATH_CACHE_SIZE > 0
+    if (index->cache) {
+        pathCacheEntry *entry = lookupPathCache(index->cache, start, finish);
+        if (entry) {
+            appendText(out, entry->text, entry->length);
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
+// Keep a freshly planned answer for the next time it is asked
+void rememberPath(stationIndex *index, int start, int finish, outputBuffer *text) {
+#if PATH_CACHE_SIZE > 0
+    if (index->cache) {
+        storePathCache(index->cache, start, finish, text->data, (int)text->size);
+    }
+#else
+    (void)index;
+    (void)start;
+    (void)finish;
+    (void)text;
+#endif
+}
+
+void findPath(stationIndex *index, int start, int finish, plannerScratch *scratch, outputBuffer *out) {
+    if (findKnownPath(index, start, finish, out)) {
+        return;
+    }
+#if PATH_CACHE_SIZE > 0
+    pathCache *cache = index->cache;
+    if (cache) {
+        cache->capture.size = 0;
+        planPath(index, start, finish, scratch, &cache->capture);
+        rememberPath(index, start, finish, &cache->capture);
+        appendText(out, cache->capture.data, cache->capture.size);
+        return;
+    }
+#endif
+    planPath(index, start, finish, scratch, out);
+}
+
+// pianifica-multiplo: what pianifica-percorso would print from start to each
+// destination, in the order given. Which station discovers which does not
+// depend on where the sweep is headed, so one sweep per direction, out to
+// the farthest destination, holds the routes to all of them.
+void findPaths(stationIndex *index, int start, int numDestinations, int *destinations, plannerScratch *scratch, outputBuffer *out) {
+    station *startStation = findStation(index, start);
+    plannerScratch backward = {0};
+    int forwardFinish = start;
+    int backwardFinish = start;
+    if (startStation) {
+        for (int i = 0; i < numDestinations; i++) {
+            int destination = destinations[i];
+            if (abs(destination - start) <= startStation->maxAutonomy || !findStation(index, destination)) {
+                continue;
+            }
+            if (destination > forwardFinish) {
+                forwardFinish = destination;
+            } else if (destination < backwardFinish) {
+                backwardFinish = destination;
+            }
+        }
+        if (forwardFinish != start) {
+            sweepLayers(startStation, forwardFinish, scratch);
+        }
+        if (backwardFinish != start) {
+            sweepLayers(startStation, backwardFinish, &backward);
+        }
+    }
+
+    for (int i = 0; i < numDestinations; i++) {
+        int destination = destinations[i];
+        if (destination == start) {
+            appendInt(out, start);
+            appendChar(out, '\n');
+            continue;
+        }
+        if (startStation == NULL || !findStation(index, destination)) {
+            appendString(out, "nessun percorso\n");
+            continue;
+        }
+        if (abs(destination - start) <= startStation->maxAutonomy) {
+            appendDirectPath(out, start, destination);
+            continue;
+        }
+        plannerScratch *sweep = destination > start ? scratch : &backward;
+        int entry = findSweepEntry(sweep, destination > start, destination);
+        if (entry == -1) {
+            appendString(out, "nessun percorso\n");
+        } else {
+            printSweepPath(sweep, entry, out);
+            // link the entries towards the start again for the next destination
+            reverseSweepLinks(sweep, 0);
+        }
+    }
+    freePlannerScratch(&backward);
+}
+
+// The sweep planner over a networkView, for the concurrent readers. A
+// position is block * VIEW_BLOCK_SIZE + offset; the entries carry the pairs
+// themselves, the view is not looked at again once they are recorded.
+typedef struct viewEntry {
+    int distance;
+    int maxAutonomy;
+    int previous;
+    int layer;
+} viewEntry;
+
+typedef struct viewScratch {
+    viewEntry *entries;
+    int count;
+    int capacity;
+} viewScratch;
+
+void freeViewScratch(viewScratch *scratch) {
+    free(scratch->entries);
+    memset(scratch, 0, sizeof(*scratch));
+}
+
+// Position of the station at distance, -1 if missing
+int findInView(const networkView *view, int distance) {
+    if (!view || view->numBlocks == 0) {
+        return -1;
+    }
+    int index = findViewBlock(view, distance);
+    viewBlock *block = view->blocks[index];
+    int offset = lowerBoundInBlock(block, distance);
+    if (offset == block->count || block->distances[offset] != distance) {
+        return -1;
+    }
+    return index * VIEW_BLOCK_SIZE + offset;
+}
+
+static inline int viewDistance(const networkView *view, int position) {
+    return view->blocks[position / VIEW_BLOCK_SIZE]->distances[position % VIEW_BLOCK_SIZE];
+}
+
+static inline int viewAutonomy(const networkView *view, int position) {
+    return view->blocks[position / VIEW_BLOCK_SIZE]->autonomies[position % VIEW_BLOCK_SIZE];
+}
+
+static inline int nextInView(const networkView *view, int position) {
+    int index = position / VIEW_BLOCK_SIZE;
+    if (position % VIEW_BLOCK_SIZE + 1 < view->blocks[index]->count) {
+        return position + 1;
+    }
+    return index + 1 < view->numBlocks ? (index + 1) * VIEW_BLOCK_SIZE : -1;
+}
+
+static inline int previousInView(const networkView *view, int position) {
+    if (position % VIEW_BLOCK_SIZE > 0) {
+        return position - 1;
+    }
+    int index = position / VIEW_BLOCK_SIZE - 1;
+    return index >= 0 ? index * VIEW_BLOCK_SIZE + view->blocks[index]->count - 1 : -1;
+}
+
+static inline void appendViewEntry(viewScratch *scratch, const networkView *view, int position, int previous) {
+    if (scratch->count == scratch->capacity) {
+        scratch->capacity = scratch->capacity ? scratch->capacity * 2 : 1024;
+        scratch->entries = (viewEntry *)realloc(scratch->entries, scratch->capacity * sizeof(viewEntry));
+    }
+    viewEntry *entry = &scratch->entries[scratch->count++];
+    entry->distance = viewDistance(view, position);
+    entry->maxAutonomy = viewAutonomy(view, position);
+    entry->previous = previous;
+    entry->layer = previous == -1 ? 0 : scratch->entries[previous].layer + 1;
+    COUNT(stationsVisited);
+}
+
+// continueSweep from the start station at position, entry of finish or -1
+static int sweepView(const networkView *view, int position, int finish, viewScratch *scratch) {
+    scratch->count = 0;
+    appendViewEntry(scratch, view, position, -1);
+    if (scratch->entries[0].distance < finish) {
+        int next = nextInView(view, position);
+        for (int i = 0; i < scratch->count; i++) {
+            viewEntry current = scratch->entries[i];
+            while (next != -1 && abs(viewDistance(view, next) - current.distance) <= current.maxAutonomy) {
+                appendViewEntry(scratch, view, next, i);
+                if (scratch->entries[scratch->count - 1].distance == finish) {
+                    return scratch->count - 1;
+                }
+                next = nextInView(view, next);
+            }
+        }
+    } else {
+        int next = previousInView(view, position);
+        int layerStart = 0;
+        int layerEnd = 1;
+        int i = 0;
+        while (layerStart < layerEnd) {
+            for (; i >= layerStart; i--) {
+                viewEntry current = scratch->entries[i];
+                while (next != -1 && abs(viewDistance(view, next) - current.distance) <= current.maxAutonomy) {
+                    appendViewEntry(scratch, view, next, i);
+                    if (scratch->entries[scratch->count - 1].distance == finish) {
+                        return scratch->count - 1;
+                    }
+                    next = previousInView(view, next);
+                }
+            }
+            layerStart = layerEnd;
+            layerEnd = scratch->count;
+            i = layerEnd - 1;
+        }
+    }
+    return -1;
+}
+
+// What pianifica-percorso prints, computed on view alone
+void planOnView(const networkView *view, int start, int finish, viewScratch *scratch, outputBuffer *out) {
+    if (start == finish) {
+        appendInt(out, start);
+        appendChar(out, '\n');
+        return;
+    }
+    int startPosition = findInView(view, start);
+    if (startPosition == -1 || findInView(view, finish) == -1) {
+        appendString(out, "nessun percorso\n");
+        return;
+    }
+    if (abs(start - finish) <= viewAutonomy(view, startPosition)) {
+        appendDirectPath(out, start, finish);
+        return;
+    }
+    int entry = sweepView(view, startPosition, finish, scratch);
+    if (entry == -1) {
+        appendString(out, "nessun percorso\n");
+        return;
+    }
+    // turn the links round and print from the start
+    int next = -1;
+    while (entry != -1) {
+        int previous = scratch->entries[entry].previous;
+        scratch->entries[entry].previous = next;
+        next = entry;
+        entry = previous;
+    }
+    for (int i = next; i != -1; i = scratch->entries[i].previous) {
+        appendInt(out, scratch->entries[i].distance);
+        appendChar(out, scratch->entries[i].previous == -1 ? '\n' : ' ');
+    }
+}
+
+// Latency histograms of --stats, one per command type. Buckets are HDR
+// style: exact below 16 ns, then 16 buckets per power of two, so a value is
+// known to within 1/16 of itself.
+#define LATENCY_SUB_BUCKETS 16
+#define LATENCY_BUCKETS (61 * LATENCY_SUB_BUCKETS)
+#define STATS_COMMAND_SLOTS 16  // more than there are command types
+
+// Commands of the log, as the input layer tells them apart
+typedef enum commandType {
+    CMD_END,
+    CMD_UNKNOWN,
+    CMD_ADD_STATION,
+    CMD_ADD_CAR,
+    CMD_DEMOLISH_STATION,
+    CMD_REMOVE_CAR,
+    CMD_PLAN_PATH,
+    CMD_REGISTER_PATH,
+    CMD_COUNT_HOPS,
+    CMD_PLAN_PATHS
+} commandType;
+
+typedef struct latencyHistogram {
+    long long count;
+    long long total;
+    long long min;
+    long long max;
+    long long buckets[LATENCY_BUCKETS];
+} latencyHistogram;
+
+#if COMMAND_STATS
+static bool statsEnabled;
+static latencyHistogram commandLatencies[STATS_COMMAND_SLOTS];
+static pthread_mutex_t latencyLock = PTHREAD_MUTEX_INITIALIZER;  // --concurrent readers record in parallel
+static long long bulkLoadedStations;
+static long long bulkLoadNanos;
+#else
+#define statsEnabled false
+#endif
+
+static inline int latencyBucket(long long nanos) {
+    if (nanos < LATENCY_SUB_BUCKETS) {
+        return nanos < 0 ? 0 : (int)nanos;
+    }
+    int exponent = 63 - __builtin_clzll((unsigned long long)nanos);
+    int sub = (int)(nanos >> (exponent - 4)) & (LATENCY_SUB_BUCKETS - 1);
+    return (exponent - 3) * LATENCY_SUB_BUCKETS + sub;
+}
+
+// Highest value that falls in bucket
+static long long latencyBucketLimit(int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) {
+        return bucket;
+    }
+    int exponent = bucket / LATENCY_SUB_BUCKETS + 3;
+    long long low = (long long)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << (exponent - 4);
+    return low + (1LL << (exponent - 4)) - 1;
+}
+
+void addLatencySample(latencyHistogram *histogram, long long nanos) {
+    if (histogram->count == 0 || nanos < histogram->min) {
+        histogram->min = nanos;
+    }
+    if (nanos > histogram->max) {
+        histogram->max = nanos;
+    }
+    histogram->count++;
+    histogram->total += nanos;
+    histogram->buckets[latencyBucket(nanos)]++;
+}
+
+void mergeLatencies(latencyHistogram *into, latencyHistogram *from) {
+    if (from->count == 0) {
+        return;
+    }
+    if (into->count == 0 || from->min < into->min) {
+        into->min = from->min;
+    }
+    if (from->max > into->max) {
+        into->max = from->max;
+    }
+    into->count += from->count;
+    into->total += from->total;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        into->buckets[bucket] += from->buckets[bucket];
+    }
+}
+
+void recordLatency(int command, long long nanos) {
+#if COMMAND_STATS
+    pthread_mutex_lock(&latencyLock);
+    addLatencySample(&commandLatencies[command], nanos);
+    pthread_mutex_unlock(&latencyLock);
+#else
+    (void)command;
+    (void)nanos;
+#endif
+}
+
+// Smallest bucket limit that covers the fraction of the samples
+long long latencyPercentile(latencyHistogram *histogram, double fraction) {
+    long long wanted = (long long)(fraction * histogram->count + 0.5);
+    if (wanted < 1) {
+        wanted = 1;
+    }
+    long long seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen >= wanted) {
+            long long limit = latencyBucketLimit(bucket);
+            return limit < histogram->max ? limit : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+// A thread that is about to exit hands its counters over
+void mergeThreadCounters(void) {
+#if COMMAND_STATS
+    long long *from = (long long *)&threadCounters;
+    long long *to = (long long *)&mergedCounters;
+    for (size_t i = 0; i < sizeof(searchCounters) / sizeof(long long); i++) {
+        __atomic_fetch_add(&to[i], from[i], __ATOMIC_RELAXED);
+    }
+    memset(&threadCounters, 0, sizeof(threadCounters));
+#endif
+}
+
+// Query batches: a run of consecutive pianifica-percorso commands cannot
+// change the network, so the run is collected and the answers that need
+// planning are planned together by a pool of threads, each with its own
+// plannerScratch, then everything is printed in the order it was asked.
+// Answers that need no planning are taken first, one by one, since they
+// update the cache and the standing routes. A batch holds all its answers
+// at once, which is what bounds its size. The pool only exists with
+// --threads n above 1, a plain run plans on the main thread.
+#ifndef QUERY_BATCH_SIZE
+#define QUERY_BATCH_SIZE 256
+#endif
+#define MAX_QUERY_THREADS 256
+
+typedef struct batchQuery {
+    int start;
+    int finish;
+    bool known;  // answered without planning
+    long long nanos;  // time taken to answer, with --stats
+    outputBuffer text;
+} batchQuery;
+
+typedef struct queryBatch queryBatch;
+
+typedef struct batchWorker {
+    queryBatch *batch;
+    plannerScratch scratch;
+    pthread_t thread;
+} batchWorker;
+
+struct queryBatch {
+    stationIndex *index;
+    batchQuery *queries;
+    int count;
+    int *toPlan;  // queries left to the planners
+    int numToPlan;
+    int next;     // next entry of toPlan to claim, taken atomically
+
+    int numWorkers;  // threads besides the one reading the commands
+    batchWorker *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t finished;
+    unsigned int generation;  // bumped for every batch handed to the workers
+    int running;              // workers still busy with the current batch
+    bool stopping;
+};
+
+static void planBatchQueries(queryBatch *batch, plannerScratch *scratch) {
+    while (1) {
+        int claimed = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+        if (claimed >= batch->numToPlan) {
+            return;
+        }
+        batchQuery *query = &batch->queries[batch->toPlan[claimed]];
+        long long started = statsEnabled ? nowNanos() : 0;
+        planPath(batch->index, query->start, query->finish, scratch, &query->text);
+        if (statsEnabled) {
+            query->nanos = nowNanos() - started;
+        }
+    }
+}
+
+static void *runBatchWorker(void *argument) {
+    batchWorker *worker = (batchWorker *)argument;
+    queryBatch *batch = worker->batch;
+    unsigned int seen = 0;
+    while (1) {
+        pthread_mutex_lock(&batch->lock);
+        while (batch->generation == seen && !batch->stopping) {
+            pthread_cond_wait(&batch->wake, &batch->lock);
+        }
+        if (batch->stopping) {
+            pthread_mutex_unlock(&batch->lock);
+            mergeThreadCounters();
+            return NULL;
+        }
+        seen = batch->generation;
+        pthread_mutex_unlock(&batch->lock);
+
+        planBatchQueries(batch, &worker->scratch);
+
+        pthread_mutex_lock(&batch->lock);
+        if (--batch->running == 0) {
+            pthread_cond_signal(&batch->finished);
+        }
+        pthread_mutex_unlock(&batch->lock);
+    }
+}
+
+void initQueryBatch(queryBatch *batch, stationIndex *index, int numThreads) {
+    memset(batch, 0, sizeof(*batch));
+    batch->index = index;
+    batch->queries = (batchQuery *)malloc(QUERY_BATCH_SIZE * sizeof(batchQuery));
+    for (int i = 0; i < QUERY_BATCH_SIZE; i++) {
+        initOutputWithCapacity(&batch->queries[i].text, -1, 64);
+    }
+    batch->toPlan = (int *)malloc(QUERY_BATCH_SIZE * sizeof(int));
+
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->wake, NULL);
+    pthread_cond_init(&batch->finished, NULL);
+    batch->workers = (batchWorker *)calloc(numThreads > 1 ? numThreads - 1 : 1, sizeof(batchWorker));
+    for (int i = 0; i < numThreads - 1; i++) {
+        batch->workers[i].batch = batch;
+        if (pthread_create(&batch->workers[i].thread, NULL, runBatchWorker, &batch->workers[i]) != 0) {
+            break;
+        }
+        batch->numWorkers++;
+    }
+}
+
+void freeQueryBatch(queryBatch *batch) {
+    pthread_mutex_lock(&batch->lock);
+    batch->stopping = true;
+    pthread_cond_broadcast(&batch->wake);
+    pthread_mutex_unlock(&batch->lock);
+    for (int i = 0; i < batch->numWorkers; i++) {
+        pthread_join(batch->workers[i].thread, NULL);
+        freePlannerScratch(&batch->workers[i].scratch);
+    }
+    free(batch->workers);
+    pthread_mutex_destroy(&batch->lock);
+    pthread_cond_destroy(&batch->wake);
+    pthread_cond_destroy(&batch->finished);
+    for (int i = 0; i < QUERY_BATCH_SIZE; i++) {
+        freeOutput(&batch->queries[i].text);
+    }
+    free(batch->queries);
+    free(batch->toPlan);
+}
+
+#if READ_INDEX && PATH_PLANNER == PLANNER_SWEEP
+// Before the planners start: collect what the last batch swept and rebuild
+// a stale read index once the tree has cost more than the copy would
+static void prepareReadIndex(queryBatch *batch, plannerScratch *scratch) {
+    stationIndex *index = batch->index;
+    if (!index->sorted) {
+        index->sorted = (readIndex *)calloc(1, sizeof(readIndex));
+        index->sorted->stale = true;
+        index->sorted->patience = 1;
+    }
+    readIndex *sorted = index->sorted;
+    long long swept = scratch->swept;
+    scratch->swept = 0;
+    for (int i = 0; i < batch->numWorkers; i++) {
+        swept += batch->workers[i].scratch.swept;
+        batch->workers[i].scratch.swept = 0;
+    }
+    if (sorted->planning) {
+        sorted->indexWork += swept;
+    } else {
+        sorted->treeWork += swept;
+    }
+    long long count = stationIds.next - stationIds.numReleased;
+    if (sorted->stale && sorted->treeWork * READ_INDEX_TREE_WEIGHT >= count * sorted->patience) {
+        if (sorted->builds > 0 && sorted->indexWork * READ_INDEX_TREE_WEIGHT < sorted->count) {
+            sorted->patience = sorted->patience < READ_INDEX_MAX_PATIENCE ? sorted->patience * 2 : READ_INDEX_MAX_PATIENCE;
+        } else if (sorted->patience > 1) {
+            sorted->patience /= 2;
+        }
+        buildReadIndex(index);
+    }
+    sorted->planning = !sorted->stale;
+    if (sorted->planning) {
+        sorted->indexQueries += batch->numToPlan;
+    } else {
+        sorted->treeQueries += batch->numToPlan;
+    }
+}
+#endif
+
+// Answer every collected query and print the answers in order
+void runQueryBatch(queryBatch *batch, plannerScratch *scratch, outputBuffer *out) {
+    if (batch->count == 0) {
+        return;
+    }
+    batch->numToPlan = 0;
+    for (int i = 0; i < batch->count; i++) {
+        batchQuery *query = &batch->queries[i];
+        query->text.size = 0;
+        long long started = statsEnabled ? nowNanos() : 0;
+        query->known = findKnownPath(batch->index, query->start, query->finish, &query->text);
+        if (statsEnabled) {
+            query->nanos = nowNanos() - started;
+        }
+        if (!query->known) {
+            batch->toPlan[batch->numToPlan++] = i;
+        }
+    }
+
+#if READ_INDEX && PATH_PLANNER == PLANNER_SWEEP
+    if (batch->numToPlan > 0) {
+        prepareReadIndex(batch, scratch);
+    }
+#endif
+    batch->next = 0;
+    if (batch->numWorkers > 0 && batch->numToPlan > 1) {
+        pthread_mutex_lock(&batch->lock);
+        batch->running = batch->numWorkers;
+        batch->generation++;
+        pthread_cond_broadcast(&batch->wake);
+        pthread_mutex_unlock(&batch->lock);
+
+        planBatchQueries(batch, scratch);
+
+        pthread_mutex_lock(&batch->lock);
+        while (batch->running > 0) {
+            pthread_cond_wait(&batch->finished, &batch->lock);
+        }
+        pthread_mutex_unlock(&batch->lock);
+    } else {
+        planBatchQueries(batch, scratch);
+    }
+
+    for (int i = 0; i < batch->count; i++) {
+        batchQuery *query = &batch->queries[i];
+        if (!query->known) {
+            rememberPath(batch->index, query->start, query->finish, &query->text);
+        }
+        if (statsEnabled) {
+            recordLatency(CMD_PLAN_PATH, query->nanos);
+        }
+        appendText(out, query->text.data, query->text.size);
+        if (query->text.capacity > OUTPUT_FLUSH_THRESHOLD) {
+            // do not keep the room of a long answer around
+            freeOutput(&query->text);
+            initOutputWithCapacity(&query->text, -1, 64);
+        }
+    }
+    batch->count = 0;
+}
+
+// First position whose one hop window reaches position, going forward
+static int firstReachingPosition(reachIndex *reach, int position) {
+    int i = reachLowerBound(reach, (long long)reach->distances[position] - reach->autonomyBound);
+    while (farthestOf(reach, i) < position) {
+        i++;
+    }
+    return i;
+}
+
+// Last position whose one hop window reaches position, going backward
+static int lastReachingPosition(reachIndex *reach, int position) {
+    int i = reachLowerBound(reach, (long long)reach->distances[position] + reach->autonomyBound + 1) - 1;
+    while (nearestOf(reach, i) > position) {
+        i--;
+    }
+    return i;
+}
+
+// Forward jumps of the positions whose windows cover low..high. Level 0 goes
+// from i to the station of [i, farthest] that reaches farthest: scanning
+// from the right, the stack keeps the positions no later position outreaches,
+// so the candidates within reach of i are a run at its top and the deepest
+// of them is the one. Level k can only change where 2^(k-1) more windows
+// lead back into the positions level k-1 changed.
+static void buildForwardJumps(reachIndex *reach, int low, int high) {
+    int first = firstReachingPosition(reach, low);
+    int end = high;
+    for (int i = first; i <= high; i++) {
+        if (farthestOf(reach, i) > end) {
+            end = farthestOf(reach, i);
+        }
+    }
+    int *stack = reach->stack;
+    int top = 0;
+    for (int i = end; i >= first; i--) {
+        while (top > 0 && farthestOf(reach, stack[top - 1]) <= farthestOf(reach, i)) {
+            top--;
+        }
+        stack[top++] = i;
+        if (i > high) {
+            continue;
+        }
+        int bottom = 0;
+        int last = top - 1;
+        while (bottom < last) {
+            int middle = bottom + (last - bottom) / 2;
+            if (stack[middle] <= farthestOf(reach, i)) {
+                last = middle;
+            } else {
+                bottom = middle + 1;
+            }
+        }
+        reach->forwardJumps[i] = stack[bottom] - i;
+    }
+    for (int k = 1; k < reach->levels; k++) {
+        for (long long step = 0; step < (1LL << (k - 1)) && first > 0; step++) {
+            int previousFirst = first;
+            first = firstReachingPosition(reach, first);
+            if (first == previousFirst) {
+                break;
+            }
+        }
+        int *previous = reach->forwardJumps + (size_t)(k - 1) * reach->capacity;
+        int *current = previous + reach->capacity;
+        for (int i = first; i <= high; i++) {
+            int middle = i + previous[i];
+            current[i] = middle + previous[middle] - i;
+        }
+    }
+}
+
+// Backward jumps of the positions whose windows cover low..high, the mirror
+// image
+static void buildBackwardJumps(reachIndex *reach, int low, int high) {
+    int last = lastReachingPosition(reach, high);
+    int start = low;
+    for (int i = low; i <= last; i++) {
+        if (nearestOf(reach, i) < start) {
+            start = nearestOf(reach, i);
+        }
+    }
+    int *stack = reach->stack;
+    int top = 0;
+    for (int i = start; i <= last; i++) {
+        while (top > 0 && nearestOf(reach, stack[top - 1]) >= nearestOf(reach, i)) {
+            top--;
+        }
+        stack[top++] = i;
+        if (i < low) {
+            continue;
+        }
+        int bottom = 0;
+        int deepest = top - 1;
+        while (bottom < deepest) {
+            int middle = bottom + (deepest - bottom) / 2;
+            if (stack[middle] >= nearestOf(reach, i)) {
+                deepest = middle;
+            } else {
+                bottom = middle + 1;
+            }
+        }
+        reach->backwardJumps[i] = i - stack[bottom];
+    }
+    for (int k = 1; k < reach->levels; k++) {
+        for (long long step = 0; step < (1LL << (k - 1)) && last < reach->count - 1; step++) {
+            int previousLast = last;
+            last = lastReachingPosition(reach, last);
+            if (last == previousLast) {
+                break;
+            }
+        }
+        int *previous = reach->backwardJumps + (size_t)(k - 1) * reach->capacity;
+        int *current = previous + reach->capacity;
+        for (int i = low; i <= last; i++) {
+            int middle = i - previous[i];
+            current[i] = i - middle + previous[middle];
+        }
+    }
+}
+
+// Take a new copy of the stations on first use or when it outgrew the
+// arrays, then rebuild the jumps the changes since the last query moved
+void refreshReachIndex(stationIndex *index) {
+    reachIndex *reach = index->reach;
+    if (!reach) {
+        reach = index->reach = (reachIndex *)calloc(1, sizeof(reachIndex));
+        reach->stale = true;
+    }
+    if (reach->stale) {
+        int count = 0;
+        for (station *node = firstStation(index); node != NULL; node = getSuccessor(node)) {
+            count++;
+        }
+        if (count >= reach->capacity) {
+            // room for the next station
+            int capacity = reach->capacity ? reach->capacity : 1024;
+            while (capacity <= count) {
+                capacity *= 2;
+            }
+            // enough levels for a route through every station
+            int levels = 1;
+            while ((1 << levels) < capacity) {
+                levels++;
+            }
+            reach->capacity = capacity;
+            reach->levels = levels;
+            reach->distances = (int *)realloc(reach->distances, capacity * sizeof(int));
+            reach->autonomies = (int *)realloc(reach->autonomies, capacity * sizeof(int));
+            reach->ahead = (int *)realloc(reach->ahead, capacity * sizeof(int));
+            reach->behind = (int *)realloc(reach->behind, capacity * sizeof(int));
+            reach->stack = (int *)realloc(reach->stack, capacity * sizeof(int));
+            reach->forwardJumps = (int *)realloc(reach->forwardJumps, (size_t)levels * capacity * sizeof(int));
+            reach->backwardJumps = (int *)realloc(reach->backwardJumps, (size_t)levels * capacity * sizeof(int));
+        }
+        reach->count = count;
+        reach->autonomyBound = 0;
+        int position = 0;
+        for (station *node = firstStation(index); node != NULL; node = getSuccessor(node)) {
+            reach->distances[position] = node->distance;
+            reach->autonomies[position++] = node->maxAutonomy;
+            if (node->maxAutonomy > reach->autonomyBound) {
+                reach->autonomyBound = node->maxAutonomy;
+            }
+        }
+        for (position = 0; position < count; position++) {
+            setReachOfPosition(reach, position);
+        }
+        reach->stale = false;
+        reach->forwardLow = reach->backwardLow = 0;
+        reach->forwardHigh = reach->backwardHigh = count - 1;
+    }
+    // a demolished last station can leave a range one past the end
+    if (reach->forwardHigh >= reach->count) {
+        reach->forwardHigh = reach->count - 1;
+    }
+    if (reach->backwardHigh >= reach->count) {
+        reach->backwardHigh = reach->count - 1;
+    }
+    if (reach->forwardLow <= reach->forwardHigh) {
+        buildForwardJumps(reach, reach->forwardLow, reach->forwardHigh);
+    }
+    if (reach->backwardLow <= reach->backwardHigh) {
+        buildBackwardJumps(reach, reach->backwardLow, reach->backwardHigh);
+    }
+    reach->forwardLow = reach->backwardLow = INT_MAX;
+    reach->forwardHigh = reach->backwardHigh = -1;
+}
+
+// conta-tappe: the number of hops of the routes pianifica-percorso prints
+void countHops(stationIndex *index, int start, int finish, outputBuffer *out) {
+    if (start == finish) {
+        appendString(out, "0\n");
+        return;
+    }
+    refreshReachIndex(index);
+    reachIndex *reach = index->reach;
+    int from = findReachPosition(reach, start);
+    int to = findReachPosition(reach, finish);
+    if (from == -1 || to == -1) {
+        appendString(out, "nessun percorso\n");
+        return;
+    }
+
+    // take the longest run of greedy jumps that still falls short of finish
+    int hops = 0;
+    int position = from;
+    bool reached;
+    if (from < to) {
+        for (int k = reach->levels - 1; k >= 0 && farthestOf(reach, position) < to; k--) {
+            int next = position + reach->forwardJumps[(size_t)k * reach->capacity + position];
+            if (farthestOf(reach, next) < to) {
+                position = next;
+                hops += 1 << k;
+            }
+        }
+        if (farthestOf(reach, position) >= to) {
+            reached = true;
+            hops += 1;
+        } else {
+            reached = farthestOf(reach, position + reach->forwardJumps[position]) >= to;
+            hops += 2;
+        }
+    } else {
+        for (int k = reach->levels - 1; k >= 0 && nearestOf(reach, position) > to; k--) {
+            int next = position - reach->backwardJumps[(size_t)k * reach->capacity + position];
+            if (nearestOf(reach, next) > to) {
+                position = next;
+                hops += 1 << k;
+            }
+        }
+        if (nearestOf(reach, position) <= to) {
+            reached = true;
+            hops += 1;
+        } else {
+            reached = nearestOf(reach, position - reach->backwardJumps[position]) <= to;
+            hops += 2;
+        }
+    }
+
+    if (reached) {
+        appendInt(out, hops);
+        appendChar(out, '\n');
+    } else {
+        appendString(out, "nessun percorso\n");
+    }
+}
+
+// Input layer: the whole command log is tokenized straight out of an mmapped
+// file, or out of large blocks read from stdin when it is a pipe
+#define INPUT_BLOCK_SIZE (1 << 20)
+// every token is shorter than this, so a refill is only needed near the end
+#define INPUT_MAX_TOKEN 64
+
+typedef struct inputReader {
+    int fd;
+    const char *cursor;
+    const char *end;
+    char *buffer;  // block buffer, NULL when the input is mmapped
+    void *mapped;
+    size_t mappedSize;
+    bool eof;
+    bool binary;  // fixed-width records instead of text, see readBinaryCommand
+    struct inputPipe *pipe;  // parser thread the records come from, may be NULL
+    // Daemon connections: called with idle set before a read that has to wait
+    // for the client and with idle clear after it, NULL for other inputs
+    void (*waiting)(void *context, bool idle);
+    void *waitingContext;
+} inputReader;
+
+// Parser stage of --pipeline: a thread tokenizes the log into binary records
+// (the --binary format) and hands them over in chunks that always end on a
+// record boundary, the reader of the executor decodes them
+#define INPUT_PIPE_CHUNKS 8
+#define INPUT_CHUNK_SIZE (1 << 18)
+
+typedef struct inputPipe {
+    spscRing full;  // chunks of records, NULL after the last one
+    spscRing free;
+    outputBuffer chunks[INPUT_PIPE_CHUNKS];
+    outputBuffer *current;  // chunk the executor is reading
+    inputReader source;
+    int stop;       // set by the executor when it needs no more input
+    bool finished;  // the executor has seen the NULL after the last chunk
+    pthread_t thread;
+} inputPipe;
+
+// Give the chunk that was read back to the parser and move to the next one
+static void takeInputChunk(inputReader *in) {
+    inputPipe *pipe = in->pipe;
+    if (in->cursor < in->end) {
+        // records never straddle chunks, a partial one ends a truncated log
+        in->eof = true;
+        return;
+    }
+    if (pipe->current) {
+        pipe->current->size = 0;
+        ringPush(&pipe->free, pipe->current);
+        pipe->current = NULL;
+    }
+    outputBuffer *chunk = (outputBuffer *)ringPop(&pipe->full);
+    if (!chunk) {
+        pipe->finished = true;
+        in->eof = true;
+        return;
+    }
+    pipe->current = chunk;
+    in->cursor = chunk->data;
+    in->end = chunk->data + chunk->size;
+}
+
+void openInput(inputReader *in, int fd) {
+    struct stat info;
+
+    in->fd = fd;
+    in->buffer = NULL;
+    in->mapped = NULL;
+    in->mappedSize = 0;
+    in->eof = false;
+    in->binary = false;
+    in->pipe = NULL;
+    in->waiting = NULL;
+    in->waitingContext = NULL;
+
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        off_t offset = lseek(fd, 0, SEEK_CUR);
+        void *mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (offset >= 0 && mapped != MAP_FAILED) {
+            madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+            in->mapped = mapped;
+            in->mappedSize = info.st_size;
+            in->cursor = (const char *)mapped + offset;
+            in->end = (const char *)mapped + info.st_size;
+            in->eof = true;
+            return;
+        }
+    }
+
+    in->buffer = (char *)malloc(INPUT_BLOCK_SIZE);
+    in->cursor = in->buffer;
+    in->end = in->buffer;
+}
+
+void stopInputPipeline(inputReader *in);
+
+void closeInput(inputReader *in) {
+    if (in->pipe) {
+        stopInputPipeline(in);
+    }
+    if (in->mapped) {
+        munmap(in->mapped, in->mappedSize);
+    }
+    free(in->buffer);
+}
+
+// A daemon connection takes whatever has arrived, and only when nothing has
+// does it tell the session it is going to wait
+static void readConnection(inputReader *in) {
+    size_t room = INPUT_BLOCK_SIZE - (in->end - in->buffer);
+    if (room == 0) {
+        in->eof = true;
+        return;
+    }
+    ssize_t got = recv(in->fd, (char *)in->end, room, MSG_DONTWAIT);
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        in->waiting(in->waitingContext, true);
+        do {
+            got = recv(in->fd, (char *)in->end, room, 0);
+        } while (got < 0 && errno == EINTR);
+        in->waiting(in->waitingContext, false);
+    }
+    if (got <= 0) {
+        in->eof = true;
+    } else {
+        in->end += got;
+    }
+}
+
+// Move the unread tail to the front of the block buffer and read more after it
+void refillInput(inputReader *in) {
+    if (in->eof) {
+        return;
+    }
+    if (in->pipe) {
+        takeInputChunk(in);
+        return;
+    }
+    size_t left = in->end - in->cursor;
+    memmove(in->buffer, in->cursor, left);
+    in->cursor = in->buffer;
+    in->end = in->buffer + left;
+
+    if (in->waiting) {
+        readConnection(in);
+        return;
+    }
+    while (!in->eof && in->end - in->buffer < INPUT_BLOCK_SIZE) {
+        ssize_t got = read(in->fd, (char *)in->end, INPUT_BLOCK_SIZE - (in->end - in->buffer));
+        if (got <= 0) {
+            in->eof = true;
+        } else {
+            in->end += got;
+        }
+        if (in->end - in->cursor >= INPUT_MAX_TOKEN) {
+            break;
+        }
+    }
+}
+
+static inline bool isSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Whether the whitespace after the next token has arrived. A client may wait
+// for an answer right after a command, so a connection cannot read ahead
+// until INPUT_MAX_TOKEN bytes are there.
+static inline bool tokenComplete(inputReader *in) {
+    const char *p = in->cursor;
+    while (p < in->end && p - in->cursor < INPUT_MAX_TOKEN) {
+        if (isSpace(*p)) {
+            return true;
+        }
+        p++;
+    }
+    return p - in->cursor == INPUT_MAX_TOKEN;
+}
+
+// Skip whitespace and make sure the next token is entirely in memory
+bool nextToken(inputReader *in) {
+    while (true) {
+        while (in->cursor < in->end && isSpace(*in->cursor)) {
+            in->cursor++;
+        }
+        if (!in->eof && (in->waiting ? !tokenComplete(in) : in->end - in->cursor < INPUT_MAX_TOKEN)) {
+            refillInput(in);
+            continue;
+        }
+        return in->cursor < in->end;
+    }
+}
+
+// Number of leading decimal digits in the 8 bytes of chunk, together with the
+// chunk turned into digit values (one per byte)
+static inline int countDigits(uint64_t *chunk) {
+    uint64_t values = *chunk ^ 0x3030303030303030ULL;
+    // high bit of a byte is set when its value is not in 0..9
+    uint64_t notDigits = (((values & 0x7F7F7F7F7F7F7F7FULL) + 0x7676767676767676ULL) | values) & 0x8080808080808080ULL;
+    *chunk = values;
+    return notDigits ? __builtin_ctzll(notDigits) >> 3 : 8;
+}
+
+// SWAR conversion of the first count digit values of chunk (1 <= count <= 8)
+static inline uint32_t parseDigits(uint64_t values, int count) {
+    values <<= 8 * (8 - count);
+    values = (values * 10 + (values >> 8)) & 0x00FF00FF00FF00FFULL;
+    values = (values * 100 + (values >> 16)) & 0x0000FFFF0000FFFFULL;
+    return (uint32_t)(values * 10000 + (values >> 32));
+}
+
+static const uint32_t powersOfTen[9] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+// Binary command protocol (--binary): every command is an opcode byte
+// followed by the int32 operands of its text form, little-endian, in the
+// same order. aggiungi-stazione is thus dist, car count and the autonomies
+// inline, pianifica-multiplo is start, count and the destinations.
+//   1 aggiungi-stazione   2 demolisci-stazione   3 aggiungi-auto
+//   4 rottama-auto        5 pianifica-percorso   6 registra-percorso
+//   7 conta-tappe         8 pianifica-multiplo
+// Any other opcode is an unknown command.
+#define NUM_OPCODES 9
+
+static const commandType opcodeCommands[NUM_OPCODES] = {
+    CMD_UNKNOWN,     CMD_ADD_STATION,   CMD_DEMOLISH_STATION, CMD_ADD_CAR,   CMD_REMOVE_CAR,
+    CMD_PLAN_PATH,   CMD_REGISTER_PATH, CMD_COUNT_HOPS,       CMD_PLAN_PATHS,
+};
+
+// Make sure count bytes are in memory, false when the input ends before
+static inline bool ensureInput(inputReader *in, size_t count) {
+    while ((size_t)(in->end - in->cursor) < count && !in->eof) {
+        refillInput(in);
+    }
+    return (size_t)(in->end - in->cursor) >= count;
+}
+
+static inline bool readBinaryInt(inputReader *in, int *value) {
+    if (!ensureInput(in, 4)) {
+        return false;
+    }
+    const unsigned char *p = (const unsigned char *)in->cursor;
+    *value = (int)((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+    in->cursor += 4;
+    return true;
+}
+
+static inline commandType readBinaryCommand(inputReader *in) {
+    if (!ensureInput(in, 1)) {
+        return CMD_END;
+    }
+    unsigned char opcode = (unsigned char)*in->cursor++;
+    return opcode < NUM_OPCODES ? opcodeCommands[opcode] : CMD_UNKNOWN;
+}
+
+// Replacement for scanf("%d"): optional sign followed by at least one digit
+bool readInt(inputReader *in, int *value) {
+    if (in->binary) {
+        return readBinaryInt(in, value);
+    }
+    if (!nextToken(in)) {
+        return false;
+    }
+    const char *p = in->cursor;
+    bool negative = false;
+    if (*p == '-' || *p == '+') {
+        negative = *p == '-';
+        p++;
+    }
+
+    long long result = 0;
+    const char *digitsStart = p;
+    while (in->end - p >= 8) {
+        uint64_t chunk;
+        memcpy(&chunk, p, sizeof(chunk));
+        int count = countDigits(&chunk);
+        if (count == 0) {
+            break;
+        }
+        result = result * powersOfTen[count] + parseDigits(chunk, count);
+        p += count;
+        if (count < 8) {
+            break;
+        }
+    }
+    while (p < in->end && *p >= '0' && *p <= '9') {
+        result = result * 10 + (*p - '0');
+        p++;
+    }
+    if (p == digitsStart) {
+        return false;
+    }
+
+    in->cursor = p;
+    *value = (int)(negative ? -result : result);
+    return true;
+}
+
+// scanf("%d") as the original command loop used it: when the input ends
+// the operand keeps its previous value and the command still runs, only a
+// token that is not a number is an error
+bool readOperand(inputReader *in, int *value) {
+    if (readInt(in, value)) {
+        return true;
+    }
+    if (in->binary) {
+        // a cut int32 is the end of the input
+        in->cursor = in->end;
+        return true;
+    }
+    return !nextToken(in);
+}
+
+// Commands are told apart by their first bytes and their length
+commandType readCommand(inputReader *in) {
+    if (in->binary) {
+        return readBinaryCommand(in);
+    }
+    if (!nextToken(in)) {
+        return CMD_END;
+    }
+    const char *token = in->cursor;
+    while (in->cursor < in->end && !isSpace(*in->cursor)) {
+        in->cursor++;
+    }
+    size_t length = in->cursor - token;
+
+    switch (token[0]) {
+        case 'a':
+            if (length == 17 && memcmp(token, "aggiungi-stazione", 17) == 0) {
+                return CMD_ADD_STATION;
+            }
+            if (length == 13 && memcmp(token, "aggiungi-auto", 13) == 0) {
+                return CMD_ADD_CAR;
+            }
+            break;
+        case 'c':
+            if (length == 11 && memcmp(token, "conta-tappe", 11) == 0) {
+                return CMD_COUNT_HOPS;
+            }
+            break;
+        case 'd':
+            if (length == 18 && memcmp(token, "demolisci-stazione", 18) == 0) {
+                return CMD_DEMOLISH_STATION;
+            }
+            break;
+        case 'r':
+            if (length == 12 && memcmp(token, "rottama-auto", 12) == 0) {
+                return CMD_REMOVE_CAR;
+            }
+            if (length == 17 && memcmp(token, "registra-percorso", 17) == 0) {
+                return CMD_REGISTER_PATH;
+            }
+            break;
+        case 'p':
+            if (length == 18 && memcmp(token, "pianifica-percorso", 18) == 0) {
+                return CMD_PLAN_PATH;
+            }
+            if (length == 18 && memcmp(token, "pianifica-multiplo", 18) == 0) {
+                return CMD_PLAN_PATHS;
+            }
+            break;
+    }
+    return CMD_UNKNOWN;
+}
+
+// Malformed input: report it after everything printed so far, the caller stops
+int inputError(outputBuffer *out, const char *message) {
+    appendString(out, message);
+    return 1;
+}
+
+// Converter between the text and the binary command formats (--encode and
+// --decode). A truncated last command is written as far as it goes, so the
+// converted log ends at the same point and its replay reuses the same
+// operands.
+static const char *const commandNames[] = {
+    [CMD_UNKNOWN] = "comando-sconosciuto",
+    [CMD_ADD_STATION] = "aggiungi-stazione",
+    [CMD_ADD_CAR] = "aggiungi-auto",
+    [CMD_DEMOLISH_STATION] = "demolisci-stazione",
+    [CMD_REMOVE_CAR] = "rottama-auto",
+    [CMD_PLAN_PATH] = "pianifica-percorso",
+    [CMD_REGISTER_PATH] = "registra-percorso",
+    [CMD_COUNT_HOPS] = "conta-tappe",
+    [CMD_PLAN_PATHS] = "pianifica-multiplo",
+};
+
+static unsigned char commandOpcode(commandType type) {
+    for (unsigned char opcode = 1; opcode < NUM_OPCODES; opcode++) {
+        if (opcodeCommands[opcode] == type) {
+            return opcode;
+        }
+    }
+    return 0;
+}
+
+static inline void appendBinaryInt(outputBuffer *out, int value) {
+    uint32_t bits = (uint32_t)value;
+    char bytes[4] = {(char)bits, (char)(bits >> 8), (char)(bits >> 16), (char)(bits >> 24)};
+    appendText(out, bytes, sizeof(bytes));
+}
+
+typedef enum convertStatus {
+    CONVERT_MORE,       // a whole command was converted
+    CONVERT_END,        // the input is over, or ended with an unknown command
+    CONVERT_TRUNCATED,  // the last command was cut short
+} convertStatus;
+
+// Convert one command, the type that was read goes to *type and, when
+// answers is not NULL, the number of answer lines it gets to *answers
+convertStatus convertCommand(inputReader *in, outputBuffer *out, bool toBinary, commandType *type, int *answers) {
+    *type = readCommand(in);
+    if (*type == CMD_END) {
+        return CONVERT_END;
+    }
+    if (toBinary) {
+        appendChar(out, (char)commandOpcode(*type));
+    } else {
+        appendString(out, commandNames[*type]);
+    }
+    // the program stops at an unknown command, so does the conversion
+    if (*type == CMD_UNKNOWN) {
+        if (!toBinary) {
+            appendChar(out, '\n');
+        }
+        return CONVERT_END;
+    }
+
+    // aggiungi-stazione and pianifica-multiplo carry a count of operands
+    long long numOperands = *type == CMD_DEMOLISH_STATION ? 1 : 2;
+    for (long long i = 0; i < numOperands; i++) {
+        int operand;
+        if (!readInt(in, &operand)) {
+            return CONVERT_TRUNCATED;
+        }
+        if (i == 1 && (*type == CMD_ADD_STATION || *type == CMD_PLAN_PATHS) && operand > 0) {
+            numOperands += operand;
+        }
+        if (i == 1 && *type == CMD_PLAN_PATHS && answers) {
+            *answers = operand;
+        }
+        if (toBinary) {
+            appendBinaryInt(out, operand);
+        } else {
+            appendChar(out, ' ');
+            appendInt(out, operand);
+        }
+    }
+    if (!toBinary) {
+        appendChar(out, '\n');
+    }
+    if (answers && *type != CMD_PLAN_PATHS) {
+        *answers = 1;
+    }
+    return CONVERT_MORE;
+}
+
+int convertCommands(inputReader *in, outputBuffer *out, bool toBinary) {
+    commandType type;
+    convertStatus status;
+    while ((status = convertCommand(in, out, toBinary, &type, NULL)) == CONVERT_MORE) {
+    }
+    if (status == CONVERT_TRUNCATED) {
+        fprintf(stderr, "truncated %s command\n", commandNames[type]);
+        return 1;
+    }
+    return 0;
+}
+
+// --stats report: JSON with the latency of every command type that ran (the
+// five basic commands always appear) and the search counters, written at
+// exit even when the input ended in an error
+void writeStats(FILE *stream) {
+#if COMMAND_STATS
+    searchCounters counters = mergedCounters;
+    long long *total = (long long *)&counters;
+    long long *own = (long long *)&threadCounters;
+    for (size_t i = 0; i < sizeof(searchCounters) / sizeof(long long); i++) {
+        total[i] += own[i];
+    }
+
+    fprintf(stream, "{\n  \"commands\": {");
+    bool first = true;
+    for (int type = CMD_ADD_STATION; type <= CMD_PLAN_PATHS; type++) {
+        latencyHistogram *histogram = &commandLatencies[type];
+        bool basic = type <= CMD_PLAN_PATH;
+        if (!basic && histogram->count == 0) {
+            continue;
+        }
+        fprintf(stream, "%s\n    \"%s\": {\"count\": %lld", first ? "" : ",", commandNames[type], histogram->count);
+        if (histogram->count > 0) {
+            fprintf(stream,
+                    ", \"mean_ns\": %lld, \"min_ns\": %lld, \"p50_ns\": %lld, \"p90_ns\": %lld, \"p99_ns\": %lld, "
+                    "\"p999_ns\": %lld, \"max_ns\": %lld",
+                    histogram->total / histogram->count, histogram->min, latencyPercentile(histogram, 0.5),
+                    latencyPercentile(histogram, 0.9), latencyPercentile(histogram, 0.99),
+                    latencyPercentile(histogram, 0.999), histogram->max);
+        }
+        fprintf(stream, "}");
+        first = false;
+    }
+    fprintf(stream, "\n  },\n  \"bulk_load\": {\"stations\": %lld, \"total_ns\": %lld},\n", bulkLoadedStations,
+            bulkLoadNanos);
+    fprintf(stream,
+            "  \"counters\": {\"stations_visited\": %lld, \"heap_pushes\": %lld, \"heap_decrease_keys\": %lld, "
+            "\"heap_pops\": %lld, \"rotations\": %lld, \"successor_climbs\": %lld, \"predecessor_climbs\": %lld}\n}\n",
+            counters.stationsVisited, counters.heapPushes, counters.heapDecreases, counters.heapPops, counters.rotations,
+            counters.successorClimbs, counters.predecessorClimbs);
+#else
+    fprintf(stream, "{\"disabled\": true}\n");
+#endif
+}
+
+static void *runInputParser(void *argument) {
+    inputPipe *pipe = (inputPipe *)argument;
+    outputBuffer *chunk = (outputBuffer *)ringPop(&pipe->free);
+    while (!__atomic_load_n(&pipe->stop, __ATOMIC_RELAXED)) {
+        commandType type;
+        convertStatus status = convertCommand(&pipe->source, chunk, true, &type, NULL);
+        if (status == CONVERT_MORE && chunk->size < INPUT_CHUNK_SIZE) {
+            continue;
+        }
+        if (chunk->size > 0) {
+            ringPush(&pipe->full, chunk);
+            if (status != CONVERT_MORE) {
+                break;
+            }
+            chunk = (outputBuffer *)ringPop(&pipe->free);
+        }
+        if (status != CONVERT_MORE) {
+            break;
+        }
+    }
+    ringPush(&pipe->full, NULL);
+    return NULL;
+}
+
+// Move the tokenizing of in to a parser thread, in then reads the binary
+// records it produces; false if the thread cannot start
+bool startInputPipeline(inputReader *in) {
+    inputPipe *pipe = (inputPipe *)malloc(sizeof(inputPipe));
+    initRing(&pipe->full);
+    initRing(&pipe->free);
+    for (int i = 0; i < INPUT_PIPE_CHUNKS; i++) {
+        initOutputWithCapacity(&pipe->chunks[i], -1, INPUT_CHUNK_SIZE + 4096);
+        ringPush(&pipe->free, &pipe->chunks[i]);
+    }
+    pipe->current = NULL;
+    pipe->source = *in;
+    pipe->stop = 0;
+    pipe->finished = false;
+    if (pthread_create(&pipe->thread, NULL, runInputParser, pipe) != 0) {
+        for (int i = 0; i < INPUT_PIPE_CHUNKS; i++) {
+            free(pipe->chunks[i].data);
+        }
+        destroyRing(&pipe->full);
+        destroyRing(&pipe->free);
+        free(pipe);
+        return false;
+    }
+    in->buffer = NULL;
+    in->mapped = NULL;
+    in->cursor = NULL;
+    in->end = NULL;
+    in->eof = false;
+    in->binary = true;
+    in->pipe = pipe;
+    return true;
+}
+
+// Stop the parser, which may still be ahead of the executor, and close its input
+void stopInputPipeline(inputReader *in) {
+    inputPipe *pipe = in->pipe;
+    __atomic_store_n(&pipe->stop, 1, __ATOMIC_RELAXED);
+    if (pipe->current) {
+        ringPush(&pipe->free, pipe->current);
+    }
+    if (!pipe->finished) {
+        outputBuffer *chunk;
+        while ((chunk = (outputBuffer *)ringPop(&pipe->full)) != NULL) {
+            ringPush(&pipe->free, chunk);
+        }
+    }
+    pthread_join(pipe->thread, NULL);
+    closeInput(&pipe->source);
+    for (int i = 0; i < INPUT_PIPE_CHUNKS; i++) {
+        free(pipe->chunks[i].data);
+    }
+    destroyRing(&pipe->full);
+    destroyRing(&pipe->free);
+    free(pipe);
+    in->pipe = NULL;
+}
+
+// Operands of the last commands, each kept from one command to the next like
+// the locals of the original loop, which a command cut by the end of the
+// input reuses
+typedef struct commandOperands {
+    int dist;
+    int numCars;
+    int cars[MAX_AUTO];
+    int singleCar;
     int carAutonomy;
+    int start;
+    int finish;
+    int numDestinations;
+} commandOperands;
+
+// Bulk load: logs open with a long run of aggiungi-stazione on an empty
+// network. The run is buffered, radix sorted by distance and built into a
+// balanced index in one pass, each command still gets its own answer.
+#ifndef BULK_LOAD
+#define BULK_LOAD 1
+#endif
+
+typedef struct stationBlock {
+    int count;
+    int capacity;
+    int *distances;
+    int *numCars;
+    size_t *firstCar;  // cars of station i start at cars[firstCar[i]]
+    int *cars;
+    size_t carCount;
+    size_t carCapacity;
+} stationBlock;
+
+void freeStationBlock(stationBlock *block) {
+    free(block->distances);
+    free(block->numCars);
+    free(block->firstCar);
+    free(block->cars);
+    memset(block, 0, sizeof(*block));
+}
+
+// Read the operands of one aggiungi-stazione, NULL or the error message
+const char *readStationOperands(inputReader *in, commandOperands *operands, stationBlock *block) {
+    if (!readOperand(in, &operands->dist)) {
+        return "Failed getting dist in aggiungi-stazione\n";
+    }
+    if (!readOperand(in, &operands->numCars)) {
+        return "Failed getting numcars in aggiungi-stazione\n";
+    }
+    int numCars = operands->numCars;
+    if (block->count == block->capacity) {
+        block->capacity = block->capacity ? block->capacity * 2 : 4096;
+        block->distances = (int *)realloc(block->distances, block->capacity * sizeof(int));
+        block->numCars = (int *)realloc(block->numCars, block->capacity * sizeof(int));
+        block->firstCar = (size_t *)realloc(block->firstCar, block->capacity * sizeof(size_t));
+    }
+    // oversized stations are rejected anyway, their cars are only skipped
+    bool keepCars = numCars > 0 && numCars <= MAX_AUTO;
+    if (keepCars && block->carCount + numCars > block->carCapacity) {
+        block->carCapacity = block->carCapacity ? block->carCapacity * 2 : 16384;
+        block->cars = (int *)realloc(block->cars, block->carCapacity * sizeof(int));
+    }
+    block->distances[block->count] = operands->dist;
+    block->numCars[block->count] = numCars;
+    block->firstCar[block->count] = block->carCount;
+    block->count++;
+    for (int i = 0; i < numCars; i++) {
+        int car = i < MAX_AUTO ? operands->cars[i] : 0;
+        if (!readOperand(in, &car)) {
+            // the station was not read entirely, it gets no answer
+            block->count--;
+            return "Failed getting car in aggiungi-stazione\n";
+        }
+        if (i < MAX_AUTO) {
+            operands->cars[i] = car;
+        }
+        if (keepCars) {
+            block->cars[block->carCount++] = car;
+        }
+    }
+    return NULL;
+}
+
+// Stable LSD radix sort of the block by distance, two 16-bit passes over
+// (distance, position) keys; returns the positions in sorted order
+int *sortStationBlock(stationBlock *block) {
+    int count = block->count;
+    uint64_t *keys = (uint64_t *)malloc(count * sizeof(uint64_t));
+    bool sorted = true;
+    for (int i = 0; i < count; i++) {
+        // flipping the sign bit makes the unsigned order the signed one
+        keys[i] = (uint64_t)((uint32_t)block->distances[i] ^ 0x80000000u) << 32 | (uint32_t)i;
+        sorted = sorted && (i == 0 || keys[i - 1] < keys[i]);
+    }
+    if (!sorted) {
+        uint64_t *buffer = (uint64_t *)malloc(count * sizeof(uint64_t));
+        int *buckets = (int *)malloc(65536 * sizeof(int));
+        for (int shift = 32; shift < 64; shift += 16) {
+            memset(buckets, 0, 65536 * sizeof(int));
+            for (int i = 0; i < count; i++) {
+                buckets[(keys[i] >> shift) & 0xFFFF]++;
+            }
+            int offset = 0;
+            for (int b = 0; b < 65536; b++) {
+                int size = buckets[b];
+                buckets[b] = offset;
+                offset += size;
+            }
+            for (int i = 0; i < count; i++) {
+                buffer[buckets[(keys[i] >> shift) & 0xFFFF]++] = keys[i];
+            }
+            uint64_t *swap = keys;
+            keys = buffer;
+            buffer = swap;
+        }
+        free(buffer);
+        free(buckets);
+    }
+    // the positions take the low halves of the keys
+    int *order = (int *)keys;
+    for (int i = 0; i < count; i++) {
+        order[i] = (int)(uint32_t)keys[i];
+    }
+    return (int *)realloc(order, count > 0 ? count * sizeof(int) : 1);
+}
+
+// Build the index out of the block and print the answers in command order:
+// the first acceptable station at each distance is added, the rest are not
+void loadStationBlock(stationBlock *block, stationIndex *index, outputBuffer *out) {
+    int *order = sortStationBlock(block);
+    char **answers = (char **)malloc((block->count > 0 ? block->count : 1) * sizeof(char *));
+    station **sorted = (station **)malloc((block->count > 0 ? block->count : 1) * sizeof(station *));
+    int built = 0;
+    for (int k = 0; k < block->count; k++) {
+        int i = order[k];
+        answers[i] = "non aggiunta\n";
+        if (block->numCars[i] > MAX_AUTO) {
+            continue;
+        }
+        if (built > 0 && sorted[built - 1]->distance == block->distances[i]) {
+            continue;
+        }
+        station *newStation = createStation(block->distances[i], block->numCars[i], block->cars + block->firstCar[i]);
+        if (!newStation) {
+            answers[i] = "memory allocation error\n";
+            continue;
+        }
+        sorted[built++] = newStation;
+        answers[i] = "aggiunta\n";
+    }
+    buildStationIndex(index, sorted, built);
+    for (int i = 0; i < block->count; i++) {
+        appendString(out, answers[i]);
+    }
+    free(order);
+    free(answers);
+    free(sorted);
+}
+
+// Called on an empty network right after an aggiungi-stazione was read:
+// consume the whole run of them and return the command that follows it, or
+// CMD_END with *error set when the input is malformed
+commandType bulkLoadStations(inputReader *in, commandOperands *operands, stationIndex *index, outputBuffer *out,
+                              const char **error) {
+#if COMMAND_STATS
+    long long started = statsEnabled ? nowNanos() : 0;
+#endif
+    stationBlock block = {0};
+    commandType type = CMD_ADD_STATION;
+    *error = NULL;
+    while (type == CMD_ADD_STATION) {
+        *error = readStationOperands(in, operands, &block);
+        if (*error) {
+            type = CMD_END;
+            break;
+        }
+        type = readCommand(in);
+    }
+    loadStationBlock(&block, index, out);
+#if COMMAND_STATS
+    if (statsEnabled) {
+        bulkLoadedStations += block.count;
+        bulkLoadNanos += nowNanos() - started;
+    }
+#endif
+    freeStationBlock(&block);
+    return type;
+}
+
+// Snapshots: --save writes the network to a binary file when the input is
+// over, also when it ended in an input error: the network is then the one
+// the commands before the malformed one left. --load starts from one instead
+// of an empty network. The file is position independent, every part is
+// found through offsets from its start, and holds the stations sorted by
+// distance in flat arrays, so it can be mmapped and read as is: loading
+// answers pianifica-percorso straight off the mapped arrays and builds the
+// index from them in one pass, without parsing or sorting, only when a
+// command needs the stations.
+//
+// Layout, little-endian, every array starts at a multiple of 8:
+//   header       struct snapshotHeader below
+//   distances    int32[stations], strictly increasing
+//   autonomies   int32[stations], maxAutonomy of each station
+//   firstEntry   uint64[stations + 1], the car entries of station i are
+//                entries[firstEntry[i]] up to entries[firstEntry[i + 1]]
+//   entries      (int32 autonomy, int32 count)[entries], by autonomy
+// The checksum is FNV-1a over the 64-bit words of everything after the
+// header. A big-endian host reads a wrong version and rejects the file.
+#define SNAPSHOT_MAGIC "AUTOSNAP"
+#define SNAPSHOT_VERSION 1
+
+typedef struct snapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t stations;
+    uint64_t entries;
+    uint64_t distancesOffset;
+    uint64_t autonomiesOffset;
+    uint64_t firstEntryOffset;
+    uint64_t entriesOffset;
+    uint64_t checksum;
+} snapshotHeader;
+
+static inline uint64_t alignSnapshotOffset(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+uint64_t snapshotChecksum(const unsigned char *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Fill in the array offsets of a header for the given counts, returns the file size
+uint64_t layOutSnapshot(snapshotHeader *header, uint64_t stations, uint64_t entries) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version = SNAPSHOT_VERSION;
+    header->headerSize = sizeof(snapshotHeader);
+    header->stations = stations;
+    header->entries = entries;
+    header->distancesOffset = alignSnapshotOffset(sizeof(snapshotHeader));
+    header->autonomiesOffset = alignSnapshotOffset(header->distancesOffset + stations * sizeof(int32_t));
+    header->firstEntryOffset = alignSnapshotOffset(header->autonomiesOffset + stations * sizeof(int32_t));
+    header->entriesOffset = header->firstEntryOffset + (stations + 1) * sizeof(uint64_t);
+    return header->entriesOffset + entries * sizeof(carEntry);
+}
+
+// Write the whole network to path, false when the file cannot be written
+bool saveSnapshot(stationIndex *index, const char *path) {
+    uint64_t stations = 0;
+    uint64_t entries = 0;
+    for (station *node = firstStation(index); node; node = getSuccessor(node)) {
+        stations++;
+        entries += stationCars(node)->numValues;
+    }
+
+    snapshotHeader header;
+    uint64_t size = layOutSnapshot(&header, stations, entries);
+    unsigned char *image = (unsigned char *)calloc(size, 1);
+    if (!image) {
+        return false;
+    }
+    int32_t *distances = (int32_t *)(image + header.distancesOffset);
+    int32_t *autonomies = (int32_t *)(image + header.autonomiesOffset);
+    uint64_t *firstEntry = (uint64_t *)(image + header.firstEntryOffset);
+    carEntry *entryArray = (carEntry *)(image + header.entriesOffset);
+    uint64_t i = 0;
+    uint64_t entry = 0;
+    for (station *node = firstStation(index); node; node = getSuccessor(node), i++) {
+        distances[i] = node->distance;
+        autonomies[i] = node->maxAutonomy;
+        firstEntry[i] = entry;
+        int numValues = stationCars(node)->numValues;
+        if (numValues > 0) {
+            // a station without cars has no entry array at all
+            memcpy(&entryArray[entry], stationCars(node)->cars, numValues * sizeof(carEntry));
+        }
+        entry += numValues;
+    }
+    firstEntry[stations] = entry;
+    header.checksum = snapshotChecksum(image + sizeof(header), size - sizeof(header));
+    memcpy(image, &header, sizeof(header));
+
+    FILE *file = fopen(path, "wb");
+    bool written = file && fwrite(image, 1, size, file) == size;
+    if (file && fclose(file) != 0) {
+        written = false;
+    }
+    free(image);
+    return written;
+}
+
+// Check that a mapped snapshot is complete and consistent, NULL or what is wrong
+const char *checkSnapshot(const unsigned char *data, size_t size) {
+    snapshotHeader header;
+    if (size < sizeof(header)) {
+        return "truncated header";
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        return "not a snapshot";
+    }
+    if (header.version != SNAPSHOT_VERSION || header.headerSize != sizeof(header)) {
+        return "unsupported version";
+    }
+    snapshotHeader expected;
+    // the counts bound the offsets, which are checked against the layout
+    if (header.stations > INT_MAX || header.entries > (uint64_t)header.stations * MAX_AUTO) {
+        return "bad counts";
+    }
+    uint64_t expectedSize = layOutSnapshot(&expected, header.stations, header.entries);
+    if (expectedSize != size || header.distancesOffset != expected.distancesOffset ||
+        header.autonomiesOffset != expected.autonomiesOffset || header.firstEntryOffset != expected.firstEntryOffset ||
+        header.entriesOffset != expected.entriesOffset) {
+        return "bad layout";
+    }
+    if (snapshotChecksum(data + sizeof(header), size - sizeof(header)) != header.checksum) {
+        return "checksum mismatch";
+    }
+
+    const int32_t *distances = (const int32_t *)(data + header.distancesOffset);
+    const int32_t *autonomies = (const int32_t *)(data + header.autonomiesOffset);
+    const uint64_t *firstEntry = (const uint64_t *)(data + header.firstEntryOffset);
+    const carEntry *entries = (const carEntry *)(data + header.entriesOffset);
+    if (firstEntry[0] != 0 || firstEntry[header.stations] != header.entries) {
+        return "bad car entries";
+    }
+    for (uint64_t i = 0; i < header.stations; i++) {
+        if (i > 0 && distances[i] <= distances[i - 1]) {
+            return "distances out of order";
+        }
+        if (firstEntry[i + 1] < firstEntry[i] || firstEntry[i + 1] > header.entries) {
+            return "bad car entries";
+        }
+        int numCars = 0;
+        for (uint64_t e = firstEntry[i]; e < firstEntry[i + 1]; e++) {
+            if (entries[e].count <= 0 || entries[e].count > MAX_AUTO - numCars ||
+                (e > firstEntry[i] && entries[e].autonomy <= entries[e - 1].autonomy)) {
+                return "bad car entries";
+            }
+            numCars += entries[e].count;
+        }
+        int last = firstEntry[i + 1] > firstEntry[i] ? entries[firstEntry[i + 1] - 1].autonomy : 0;
+        if (autonomies[i] != (last < 0 ? 0 : last)) {
+            return "bad maxAutonomy";
+        }
+    }
+    return NULL;
+}
 
-    int start;
-    int finish;
+// A snapshot kept mapped by loadSnapshot until its stations are built
+typedef struct loadedSnapshot {
+    void *mapped;
+    size_t size;
+} loadedSnapshot;
+
+void freeLoadedSnapshot(loadedSnapshot *loaded) {
+    if (!loaded) {
+        return;
+    }
+    munmap(loaded->mapped, loaded->size);
+    free(loaded);
+}
+
+// Build the stations of the snapshot loadSnapshot below left mapped, if any
+void buildLoadedStations(stationIndex *index) {
+    loadedSnapshot *loaded = index->loaded;
+    if (!loaded) {
+        return;
+    }
+    index->loaded = NULL;
+    const unsigned char *data = (const unsigned char *)loaded->mapped;
+    snapshotHeader header;
+    memcpy(&header, data, sizeof(header));
+    const int32_t *distances = (const int32_t *)(data + header.distancesOffset);
+    const uint64_t *firstEntry = (const uint64_t *)(data + header.firstEntryOffset);
+    const carEntry *entries = (const carEntry *)(data + header.entriesOffset);
+    int count = (int)header.stations;
+    station **sorted = (station **)malloc((count > 0 ? count : 1) * sizeof(station *));
+    for (int i = 0; i < count; i++) {
+        station *newStation = createStation(distances[i], 0, NULL);
+        if (!newStation) {
+            fprintf(stderr, "snapshot: out of memory after %d stations\n", i);
+            count = i;
+            break;
+        }
+        int numValues = (int)(firstEntry[i + 1] - firstEntry[i]);
+        carList *carPool = stationCars(newStation);
+        if (numValues > 0) {
+            reserveCarPool(carPool, numValues);
+            memcpy(carPool->cars, &entries[firstEntry[i]], numValues * sizeof(carEntry));
+            carPool->numValues = numValues;
+            for (int e = 0; e < numValues; e++) {
+                carPool->numCars += carPool->cars[e].count;
+            }
+        }
+        newStation->maxAutonomy = getMaxAutonomy(carPool);
+        sorted[i] = newStation;
+    }
+    if (index->sorted && index->sorted->borrowed) {
+        // the arrays go with the mapping, the next build allocates its own
+        index->sorted->distances = NULL;
+        index->sorted->autonomies = NULL;
+        index->sorted->capacity = 0;
+        index->sorted->borrowed = false;
+    }
+    buildStationIndex(index, sorted, count);
+    free(sorted);
+    freeLoadedSnapshot(loaded);
+}
+
+// Start from the network in the snapshot at path, the index must be empty.
+// NULL or what went wrong. The stations are not built here: the read index
+// takes the mapped distance and maxAutonomy arrays as they are, so
+// pianifica-percorso is answered off the file, and the first command that
+// needs the stations builds them.
+const char *loadSnapshot(stationIndex *index, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return "cannot open";
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return "cannot read";
+    }
+    void *mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return "cannot map";
+    }
+    const char *problem = checkSnapshot((const unsigned char *)mapped, info.st_size);
+    if (problem) {
+        munmap(mapped, info.st_size);
+        return problem;
+    }
+    index->loaded = (loadedSnapshot *)malloc(sizeof(loadedSnapshot));
+    index->loaded->mapped = mapped;
+    index->loaded->size = info.st_size;
+
+#if READ_INDEX && PATH_PLANNER == PLANNER_SWEEP
+    snapshotHeader header;
+    memcpy(&header, mapped, sizeof(header));
+    readIndex *sorted = (readIndex *)calloc(1, sizeof(readIndex));
+    sorted->count = (int)header.stations;
+    sorted->distances = (int *)((unsigned char *)mapped + header.distancesOffset);
+    sorted->autonomies = (int *)((unsigned char *)mapped + header.autonomiesOffset);
+    sorted->borrowed = true;
+    sorted->tree = (eytzingerEntry *)malloc((sorted->count + 1) * sizeof(eytzingerEntry));
+    fillEytzinger(sorted, 0, 1);
+    sorted->patience = 1;
+    index->sorted = sorted;
+#else
+    buildLoadedStations(index);
+#endif
+    return NULL;
+}
+
+// What a stream of commands runs against. Streams can share the network,
+// the scratch and the batch as long as only one of them runs at a time.
+typedef struct commandContext {
+    stationIndex *stations;
+    plannerScratch *scratch;
+    queryBatch *batch;
+    int *destinations;  // operands of pianifica-multiplo
+    int destinationCapacity;
+    pthread_mutex_t *writer;  // taken around every use of the tree, NULL with a single thread
+    int viewReader;           // reader slot of --concurrent, -1 reads under writer
+    viewScratch sweep;        // pianifica-percorso on the view
+    commandOperands operands;
+} commandContext;
+
+static inline void beginWrite(commandContext *context) {
+    if (context->writer) {
+        pthread_mutex_lock(context->writer);
+    }
+}
+
+static inline void endWrite(commandContext *context) {
+    if (context->writer) {
+        pthread_mutex_unlock(context->writer);
+    }
+}
 
-    station *root = NULL;
+// pianifica-percorso with --concurrent: the changes so far are published
+// first, so the answer is the one the command gets in order, then the
+// planner runs on the view with no lock at all
+static void answerFromView(commandContext *context, int start, int finish, outputBuffer *out) {
+    long long started = statsEnabled ? nowNanos() : 0;
+    viewDomain *views = context->stations->views;
+    if (__atomic_load_n(&views->pending, __ATOMIC_ACQUIRE) || context->viewReader < 0) {
+        beginWrite(context);
+        if (views->pending) {
+            publishView(context->stations);
+        }
+        if (context->viewReader >= 0) {
+            endWrite(context);
+        }
+    }
+    const networkView *view = enterView(views, context->viewReader);
+    planOnView(view, start, finish, &context->sweep, out);
+    leaveView(views, context->viewReader);
+    if (context->viewReader < 0) {
+        endWrite(context);
+    }
+    if (statsEnabled) {
+        recordLatency(CMD_PLAN_PATH, nowNanos() - started);
+    }
+}
+
+// Run the commands of in, type is the first one and has already been read.
+// All the answers are in out when it returns, nonzero after malformed input.
+int runCommands(commandContext *context, inputReader *in, outputBuffer *out, commandType type) {
+    stationIndex *stations = context->stations;
+    plannerScratch *scratch = context->scratch;
+    queryBatch *batch = context->batch;
+
+    commandOperands *operands = &context->operands;
 
-    while (scanf("%18s", command) == 1) {
-        if (strcmp(command, "aggiungi-stazione") == 0) {
-            if (!scanf("%d", &dist)) {
-                printf("Failed getting dist in aggiungi-stazione\n");
-                return 1;
+    for (; type != CMD_END; type = readCommand(in)) {
+        if (type != CMD_PLAN_PATH) {
+            runQueryBatch(batch, scratch, out);
+        }
+#if READ_INDEX && PATH_PLANNER == PLANNER_SWEEP
+        bool needsStations = type != CMD_PLAN_PATH;
+#else
+        bool needsStations = true;
+#endif
+        if (stations->loaded && needsStations) {
+            beginWrite(context);
+            buildLoadedStations(stations);
+            endWrite(context);
+        }
+        // pianifica-percorso is timed when its batch answers it
+        long long started = statsEnabled && type != CMD_PLAN_PATH ? nowNanos() : 0;
+
+        if (type == CMD_ADD_STATION) {
+            if (!readOperand(in, &operands->dist)) {
+                return inputError(out, "Failed getting dist in aggiungi-stazione\n");
             }
 
-            if (!scanf("%d", &numCars)) {
-                printf("Failed getting numcars in aggiungi-stazione\n");
-                return 1;
+            if (!readOperand(in, &operands->numCars)) {
+                return inputError(out, "Failed getting numcars in aggiungi-stazione\n");
             }
 
-            for (int i = 0; i < numCars; i++) {
-                if (!scanf("%d", &cars[i])) {
-                    printf("Failed getting car in aggiungi-stazione\n");
-                    return 1;
+            for (int i = 0; i < operands->numCars; i++) {
+                // oversized stations are rejected by addStation, just skip the extra cars
+                int car = i < MAX_AUTO ? operands->cars[i] : 0;
+                if (!readOperand(in, &car)) {
+                    return inputError(out, "Failed getting car in aggiungi-stazione\n");
+                }
+                if (i < MAX_AUTO) {
+                    operands->cars[i] = car;
                 }
             }
 
-            printf("%s", addStation(&root, dist, numCars, cars));
+            beginWrite(context);
+            appendString(out, addStation(stations, operands->dist, operands->numCars, operands->cars));
+            endWrite(context);
+
+        } else if (type == CMD_ADD_CAR) {
+            if (!readOperand(in, &operands->dist)) {
+                return inputError(out, "Failed getting dist in aggiungi-auto\n");
+            }
+
+            if (!readOperand(in, &operands->singleCar)) {
+                return inputError(out, "Failed getting car in aggiungi-auto\n");
+            }
+
+            beginWrite(context);
+            appendString(out, addCar(stations, operands->dist, operands->singleCar));
+            endWrite(context);
+
+        } else if (type == CMD_DEMOLISH_STATION) {
+            if (!readOperand(in, &operands->dist)) {
+                return inputError(out, "Failed getting dist in demolisci-stazione\n");
+            }
+            beginWrite(context);
+            appendString(out, demolishStation(stations, operands->dist));
+            endWrite(context);
+
+        } else if (type == CMD_REMOVE_CAR) {
+            if (!readOperand(in, &operands->dist)) {
+                return inputError(out, "Failed getting dist in rottama-auto\n");
+            }
 
-        } else if (strcmp(command, "aggiungi-auto") == 0) {
-            if (!scanf("%d", &dist)) {
-                printf("Failed getting dist in aggiungi-auto\n");
-                return 1;
+            if (!readOperand(in, &operands->carAutonomy)) {
+                return inputError(out, "Failed getting carAutonomy in rottama-auto\n");
+            }
+            beginWrite(context);
+            appendString(out, removeCar(stations, operands->dist, operands->carAutonomy));
+            endWrite(context);
+
+        } else if (type == CMD_PLAN_PATH) {
+            if (!readOperand(in, &operands->start)) {
+                runQueryBatch(batch, scratch, out);
+                return inputError(out, "Failed getting start in pianifica-percorso\n");
             }
 
-            if (!scanf("%d", &singleCar)) {
-                printf("Failed getting car in aggiungi-auto\n");
-                return 1;
+            if (!readOperand(in, &operands->finish)) {
+                runQueryBatch(batch, scratch, out);
+                return inputError(out, "Failed getting finish in pianifica-percorso\n");
+            }
+            if (stations->views) {
+                answerFromView(context, operands->start, operands->finish, out);
+                continue;
+            }
+            if (batch->count == QUERY_BATCH_SIZE) {
+                runQueryBatch(batch, scratch, out);
             }
+            batch->queries[batch->count].start = operands->start;
+            batch->queries[batch->count].finish = operands->finish;
+            batch->count++;
 
-            printf("%s", addCar(&root, dist, singleCar));
+        } else if (type == CMD_REGISTER_PATH) {
+            if (!readOperand(in, &operands->start)) {
+                return inputError(out, "Failed getting start in registra-percorso\n");
+            }
 
-        } else if (strcmp(command, "demolisci-stazione") == 0) {
-            if (!scanf("%d", &dist)) {
-                printf("Failed getting dist in demolisci-stazione\n");
-                return 1;
+            if (!readOperand(in, &operands->finish)) {
+                return inputError(out, "Failed getting finish in registra-percorso\n");
             }
-            // printf("%s", removeStation(&root, dist));
-            removeStationFromTreeAVL(&root, dist);
+            beginWrite(context);
+            appendString(out, registerStandingRoute(stations, operands->start, operands->finish));
+            endWrite(context);
 
-        } else if (strcmp(command, "rottama-auto") == 0) {
-            if (!scanf("%d", &dist)) {
-                printf("Failed getting dist in rottama-auto\n");
-                return 1;
+        } else if (type == CMD_COUNT_HOPS) {
+            if (!readOperand(in, &operands->start)) {
+                return inputError(out, "Failed getting start in conta-tappe\n");
             }
 
-            if (!scanf("%d", &carAutonomy)) {
-                printf("Failed getting carAutonomy in rottama-auto\n");
-                return 1;
+            if (!readOperand(in, &operands->finish)) {
+                return inputError(out, "Failed getting finish in conta-tappe\n");
             }
-            printf("%s", removeCar(&root, dist, carAutonomy));
+            beginWrite(context);
+            countHops(stations, operands->start, operands->finish, out);
+            endWrite(context);
 
-        } else if (strcmp(command, "pianifica-percorso") == 0) {
-            if (!scanf("%d", &start)) {
-                printf("Failed getting start in pianifica-percorso\n");
-                return 1;
+        } else if (type == CMD_PLAN_PATHS) {
+            if (!readOperand(in, &operands->start)) {
+                return inputError(out, "Failed getting start in pianifica-multiplo\n");
             }
 
-            if (!scanf("%d", &finish)) {
-                printf("Failed getting finish in pianifica-percorso\n");
-                return 1;
+            if (!readOperand(in, &operands->numDestinations) || operands->numDestinations < 0) {
+                return inputError(out, "Failed getting n in pianifica-multiplo\n");
+            }
+            if (operands->numDestinations > context->destinationCapacity) {
+                context->destinationCapacity = operands->numDestinations;
+                context->destinations = (int *)realloc(context->destinations, context->destinationCapacity * sizeof(int));
+            }
+            for (int i = 0; i < operands->numDestinations; i++) {
+                if (!readOperand(in, &context->destinations[i])) {
+                    return inputError(out, "Failed getting destination in pianifica-multiplo\n");
+                }
             }
-            findPath(root, start, finish);
+            beginWrite(context);
+            findPaths(stations, operands->start, operands->numDestinations, context->destinations, scratch, out);
+            endWrite(context);
 
         } else {
-            printf("Comando non riconosciuto\n");
+            appendString(out, "Comando non riconosciuto\n");
             break;
         }
+        if (statsEnabled && type != CMD_PLAN_PATH) {
+            recordLatency(type, nowNanos() - started);
+        }
     }
-    freeTree(&root);
-
+    runQueryBatch(batch, scratch, out);
     return 0;
 }
+
+// The usual run: commands from stdin, answers to stdout
+int runCommandLog(commandContext *context, bool binary, bool pipeline) {
+    inputReader in;
+    openInput(&in, STDIN_FILENO);
+    in.binary = binary;
+    outputBuffer out;
+    initOutput(&out, STDOUT_FILENO);
+    if (pipeline) {
+        // parsing and writing move to threads of their own; without them
+        // the commands simply run serially
+        startInputPipeline(&in);
+        startOutputPipeline(&out);
+    }
+
+    commandType type = readCommand(&in);
+    int status = 0;
+#if BULK_LOAD
+    if (type == CMD_ADD_STATION && !context->stations->loaded && firstStation(context->stations) == NULL) {
+        const char *error;
+        type = bulkLoadStations(&in, &context->operands, context->stations, &out, &error);
+        if (error) {
+            status = inputError(&out, error);
+        }
+    }
+#endif
+    if (status == 0) {
+        status = runCommands(context, &in, &out, type);
+    }
+    freeOutput(&out);
+    closeInput(&in);
+    return status;
+}
+
+// The address of the socket at path, false when the path does not fit
+static bool socketAddress(struct sockaddr_un *address, const char *path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+// SIGINT and SIGTERM, which --serve takes with sigwait instead of dying
+static void stopSignals(sigset_t *signals) {
+    sigemptyset(signals);
+    sigaddset(signals, SIGINT);
+    sigaddset(signals, SIGTERM);
+}
+
+// --serve: a daemon that keeps the network in memory and takes commands over
+// a Unix domain socket. A connection is a command stream in the format of
+// stdin (or of --binary) and gets its answers in order, so clients can send
+// any number of commands before they read. A connection runs whatever it has
+// received under the network lock, which keeps its pianifica-percorso in
+// batches, and when it has to wait for more it gives the lock up and writes
+// all its answers at once. With --concurrent the lock is only taken by the
+// commands that use the tree and pianifica-percorso runs on the published
+// view alongside them. Malformed input and unknown commands end the
+// connection the way they end the program. SIGINT and SIGTERM stop the
+// daemon once the open connections have run what they sent; --stats and
+// --save then cover everything the daemon did.
+typedef struct daemonSession daemonSession;
+
+typedef struct commandDaemon {
+    commandContext *context;
+    bool binary;
+    int listener;
+    bool stopping;
+    pthread_mutex_t network;  // held by the connection that runs commands
+    pthread_mutex_t lock;     // guards sessions
+    pthread_cond_t closed;
+    daemonSession *sessions;
+} commandDaemon;
+
+struct daemonSession {
+    commandDaemon *daemon;
+    int fd;
+    outputBuffer out;  // collects the answers until the session waits
+    daemonSession *next;
+};
+
+// Answers are written outside the network lock, a slow client only holds
+// up itself
+static void writeSessionOutput(daemonSession *session) {
+    session->out.fd = session->fd;
+    flushOutput(&session->out);
+    session->out.fd = -1;
+}
+
+static void sessionWaiting(void *context, bool idle) {
+    daemonSession *session = (daemonSession *)context;
+    commandDaemon *daemon = session->daemon;
+    if (daemon->context->stations->views) {
+        if (idle) {
+            writeSessionOutput(session);
+        }
+    } else if (idle) {
+        runQueryBatch(daemon->context->batch, daemon->context->scratch, &session->out);
+        pthread_mutex_unlock(&daemon->network);
+        writeSessionOutput(session);
+    } else {
+        pthread_mutex_lock(&daemon->network);
+    }
+}
+
+static void *runSession(void *argument) {
+    daemonSession *session = (daemonSession *)argument;
+    commandDaemon *daemon = session->daemon;
+    // everything is shared but the operands of pianifica-multiplo
+    commandContext context = *daemon->context;
+    context.destinations = NULL;
+    context.destinationCapacity = 0;
+    viewDomain *views = context.stations->views;
+    if (views) {
+        context.writer = &daemon->network;
+        context.viewReader = claimViewReader(views);
+        memset(&context.sweep, 0, sizeof(context.sweep));
+    }
+
+    inputReader in;
+    openInput(&in, session->fd);
+    in.binary = daemon->binary;
+    in.waiting = sessionWaiting;
+    in.waitingContext = session;
+    initOutput(&session->out, -1);
+
+    if (views) {
+        runCommands(&context, &in, &session->out, readCommand(&in));
+        releaseViewReader(views, context.viewReader);
+        freeViewScratch(&context.sweep);
+    } else {
+        pthread_mutex_lock(&daemon->network);
+        runCommands(&context, &in, &session->out, readCommand(&in));
+        pthread_mutex_unlock(&daemon->network);
+    }
+    writeSessionOutput(session);
+    closeInput(&in);
+    freeOutput(&session->out);
+    free(context.destinations);
+    mergeThreadCounters();
+
+    pthread_mutex_lock(&daemon->lock);
+    daemonSession **link = &daemon->sessions;
+    while (*link != session) {
+        link = &(*link)->next;
+    }
+    *link = session->next;
+    close(session->fd);
+    pthread_cond_signal(&daemon->closed);
+    pthread_mutex_unlock(&daemon->lock);
+    free(session);
+    return NULL;
+}
+
+// Wait for a stop signal and make accept() in serveCommands fail
+static void *waitForStop(void *argument) {
+    commandDaemon *daemon = (commandDaemon *)argument;
+    sigset_t signals;
+    stopSignals(&signals);
+    int signal;
+    sigwait(&signals, &signal);
+    __atomic_store_n(&daemon->stopping, true, __ATOMIC_RELAXED);
+    shutdown(daemon->listener, SHUT_RDWR);
+    return NULL;
+}
+
+// Run the daemon until it is stopped. SIGINT and SIGTERM have to be blocked
+// in every thread of the process already.
+int serveCommands(commandContext *context, const char *path, bool binary) {
+    struct sockaddr_un address;
+    if (!socketAddress(&address, path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return 1;
+    }
+    struct stat info;
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);  // left behind by an earlier daemon
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        fprintf(stderr, "cannot listen on %s: %s\n", path, strerror(errno));
+        if (listener >= 0) {
+            close(listener);
+        }
+        return 1;
+    }
+    // a client that goes away must not take the daemon with it
+    signal(SIGPIPE, SIG_IGN);
+
+    commandDaemon daemon;
+    daemon.context = context;
+    daemon.binary = binary;
+    daemon.listener = listener;
+    daemon.stopping = false;
+    pthread_mutex_init(&daemon.network, NULL);
+    pthread_mutex_init(&daemon.lock, NULL);
+    pthread_cond_init(&daemon.closed, NULL);
+    daemon.sessions = NULL;
+
+    int status = 0;
+    pthread_t waiter;
+    bool accepting = pthread_create(&waiter, NULL, waitForStop, &daemon) == 0;
+    if (!accepting) {
+        fprintf(stderr, "cannot start the daemon\n");
+        status = 1;
+    }
+    while (accepting) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (!__atomic_load_n(&daemon.stopping, __ATOMIC_RELAXED)) {
+                fprintf(stderr, "cannot accept on %s: %s\n", path, strerror(errno));
+                status = 1;
+                pthread_kill(waiter, SIGTERM);
+            }
+            pthread_join(waiter, NULL);
+            accepting = false;
+            continue;
+        }
+        daemonSession *session = (daemonSession *)malloc(sizeof(daemonSession));
+        session->daemon = &daemon;
+        session->fd = fd;
+        pthread_t thread;
+        pthread_mutex_lock(&daemon.lock);
+        if (pthread_create(&thread, NULL, runSession, session) == 0) {
+            pthread_detach(thread);
+            session->next = daemon.sessions;
+            daemon.sessions = session;
+        } else {
+            close(fd);
+            free(session);
+        }
+        pthread_mutex_unlock(&daemon.lock);
+    }
+
+    // let the connections run what they have received and wait for them
+    pthread_mutex_lock(&daemon.lock);
+    for (daemonSession *session = daemon.sessions; session; session = session->next) {
+        shutdown(session->fd, SHUT_RD);
+    }
+    while (daemon.sessions) {
+        pthread_cond_wait(&daemon.closed, &daemon.lock);
+    }
+    pthread_mutex_unlock(&daemon.lock);
+    close(listener);
+    unlink(path);
+    pthread_mutex_destroy(&daemon.network);
+    pthread_mutex_destroy(&daemon.lock);
+    pthread_cond_destroy(&daemon.closed);
+    return status;
+}
+
+#if DEV_TOOLS
+// --client: load generator for --serve. The command log on stdin is dealt
+// out round robin to the connections, each keeps up to depth commands in
+// flight and times every command from the write that sends it to the last
+// line of its answer. Answers are counted, not checked. A window of depth
+// commands should fit in the socket buffer, the client only reads once it
+// has written the whole window.
+#define CLIENT_READ_SIZE (1 << 16)
+
+typedef struct clientConnection {
+    const char *path;
+    int depth;
+    outputBuffer requests;  // the commands, in the format the daemon reads
+    size_t *ends;           // where each command ends in requests
+    int *answers;           // lines of answer each command gets
+    int count;
+    int capacity;
+    latencyHistogram latencies;
+    bool failed;
+    bool started;
+    pthread_t thread;
+} clientConnection;
+
+static int connectToDaemon(const char *path) {
+    struct sockaddr_un address;
+    if (!socketAddress(&address, path)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static bool writeAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Time the commands whose answers are complete, the first of them is done,
+// *left is the number of answer lines it still misses; returns the new done
+static int settleCommands(clientConnection *connection, long long *sentAt, int done, int sent, int *left,
+                          long long now) {
+    while (done < sent && *left == 0) {
+        addLatencySample(&connection->latencies, now - sentAt[done]);
+        done++;
+        *left = done < connection->count ? connection->answers[done] : 0;
+    }
+    return done;
+}
+
+static void *runClientConnection(void *argument) {
+    clientConnection *connection = (clientConnection *)argument;
+    int fd = connectToDaemon(connection->path);
+    if (fd < 0) {
+        connection->failed = true;
+        return NULL;
+    }
+    long long *sentAt = (long long *)malloc((connection->count + 1) * sizeof(long long));
+    char *buffer = (char *)malloc(CLIENT_READ_SIZE);
+    int sent = 0;
+    int done = 0;
+    int left = connection->count > 0 ? connection->answers[0] : 0;
+    size_t written = 0;
+    while (done < connection->count) {
+        if (sent < connection->count && sent - done < connection->depth) {
+            int last = done + connection->depth < connection->count ? done + connection->depth : connection->count;
+            long long now = nowNanos();
+            while (sent < last) {
+                sentAt[sent++] = now;
+            }
+            size_t upTo = connection->ends[last - 1];
+            if (!writeAll(fd, connection->requests.data + written, upTo - written)) {
+                connection->failed = true;
+                break;
+            }
+            written = upTo;
+            if (sent == connection->count) {
+                shutdown(fd, SHUT_WR);
+            }
+            done = settleCommands(connection, sentAt, done, sent, &left, now);
+            continue;
+        }
+        ssize_t got = read(fd, buffer, CLIENT_READ_SIZE);
+        if (got <= 0) {
+            connection->failed = true;
+            break;
+        }
+        long long now = nowNanos();
+        for (ssize_t i = 0; i < got; i++) {
+            if (buffer[i] != '\n') {
+                continue;
+            }
+            if (done == sent) {
+                // more answers than commands: the daemon does not read this log
+                // the way the client does
+                connection->failed = true;
+                break;
+            }
+            left--;
+            done = settleCommands(connection, sentAt, done, sent, &left, now);
+        }
+        if (connection->failed) {
+            break;
+        }
+    }
+    close(fd);
+    free(sentAt);
+    free(buffer);
+    return NULL;
+}
+
+int runClient(const char *path, int numConnections, int depth, bool binary) {
+    signal(SIGPIPE, SIG_IGN);
+    clientConnection *connections = (clientConnection *)calloc(numConnections, sizeof(clientConnection));
+    for (int i = 0; i < numConnections; i++) {
+        connections[i].path = path;
+        connections[i].depth = depth;
+        initOutput(&connections[i].requests, -1);
+    }
+
+    // the unknown command or the cut short one that ends the log is not sent
+    inputReader in;
+    openInput(&in, STDIN_FILENO);
+    in.binary = binary;
+    int status = 0;
+    long long total = 0;
+    for (int next = 0;; next = (next + 1) % numConnections) {
+        clientConnection *connection = &connections[next];
+        if (connection->count == connection->capacity) {
+            connection->capacity = connection->capacity ? connection->capacity * 2 : 1024;
+            connection->ends = (size_t *)realloc(connection->ends, connection->capacity * sizeof(size_t));
+            connection->answers = (int *)realloc(connection->answers, connection->capacity * sizeof(int));
+        }
+        commandType type;
+        int answers;
+        convertStatus result = convertCommand(&in, &connection->requests, binary, &type, &answers);
+        if (result != CONVERT_MORE) {
+            connection->requests.size = connection->count ? connection->ends[connection->count - 1] : 0;
+            if (result == CONVERT_TRUNCATED) {
+                fprintf(stderr, "truncated %s command\n", commandNames[type]);
+                status = 1;
+            }
+            break;
+        }
+        connection->ends[connection->count] = connection->requests.size;
+        connection->answers[connection->count] = answers > 0 ? answers : 0;
+        connection->count++;
+        total++;
+    }
+    closeInput(&in);
+
+    long long started = nowNanos();
+    for (int i = 0; i < numConnections; i++) {
+        connections[i].started = pthread_create(&connections[i].thread, NULL, runClientConnection, &connections[i]) == 0;
+        if (!connections[i].started) {
+            connections[i].failed = true;
+        }
+    }
+    latencyHistogram latencies;
+    memset(&latencies, 0, sizeof(latencies));
+    int failures = 0;
+    for (int i = 0; i < numConnections; i++) {
+        if (connections[i].started) {
+            pthread_join(connections[i].thread, NULL);
+        }
+    }
+    double seconds = (nowNanos() - started) / 1e9;
+    for (int i = 0; i < numConnections; i++) {
+        failures += connections[i].failed;
+        mergeLatencies(&latencies, &connections[i].latencies);
+        freeOutput(&connections[i].requests);
+        free(connections[i].ends);
+        free(connections[i].answers);
+    }
+    free(connections);
+
+    fprintf(stderr, "client: %lld commands over %d connections at depth %d in %.3f s, %.0f commands/s\n", total,
+            numConnections, depth, seconds, seconds > 0 ? latencies.count / seconds : 0.0);
+    if (latencies.count > 0) {
+        fprintf(stderr, "client: latency mean %lld ns, p50 %lld ns, p90 %lld ns, p99 %lld ns, p999 %lld ns, max %lld ns\n",
+                latencies.total / latencies.count, latencyPercentile(&latencies, 0.5),
+                latencyPercentile(&latencies, 0.9), latencyPercentile(&latencies, 0.99),
+                latencyPercentile(&latencies, 0.999), latencies.max);
+    }
+    if (failures > 0) {
+        fprintf(stderr, "client: %d of %d connections failed\n", failures, numConnections);
+        status = 1;
+    }
+    return status;
+}
+#endif
+
+#if DEV_TOOLS
+// xorshift64*
+static inline uint64_t nextRandom(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// --stress n: a writer applies n random mutations to a random network and
+// publishes a view every few of them, while --threads readers plan random
+// routes on whatever view is published and check what they read. A view
+// must be in distance order and match its checksum; a route must go from
+// start to finish between stations of the view, every hop within the
+// autonomy of the station it leaves, in the fewest hops; "nessun percorso"
+// must mean there is no route. Every so often the writer compares the
+// published view with the tree, and at the end everything retired must
+// have been freed. Exit status 1 on any mismatch.
+#define STRESS_STATIONS 20000
+#define STRESS_MAX_DISTANCE 1000000
+#define STRESS_MAX_AUTONOMY 12000
+#define STRESS_PUBLISH_EVERY 8
+#define STRESS_CHECK_EVERY 4096
+
+typedef struct stressReader {
+    viewDomain *views;
+    int slot;
+    bool *stop;
+    uint64_t seed;
+    long long routes;
+    long long failures;
+    pthread_t thread;
+} stressReader;
+
+// Blocks in distance order that match the directory, count and checksum
+static bool checkView(const networkView *view) {
+    uint64_t checksum = 0;
+    int count = 0;
+    long long last = LLONG_MIN;
+    for (int i = 0; i < view->numBlocks; i++) {
+        viewBlock *block = view->blocks[i];
+        if (block->count <= 0 || block->count > VIEW_BLOCK_SIZE || view->firsts[i] != block->distances[0]) {
+            return false;
+        }
+        for (int j = 0; j < block->count; j++) {
+            if (block->distances[j] <= last) {
+                return false;
+            }
+            last = block->distances[j];
+            checksum += viewPairHash(block->distances[j], block->autonomies[j]);
+        }
+        count += block->count;
+    }
+    return count == view->count && checksum == view->checksum;
+}
+
+// Fewest hops from start to finish on view, -1 when finish cannot be
+// reached: the jump game, one pass over the stations in between
+static int minimumHops(const networkView *view, int start, int finish) {
+    int position = findInView(view, start);
+    bool forward = start < finish;
+    long long limit = (long long)start + (forward ? 1 : -1) * viewAutonomy(view, position);
+    long long best = limit;
+    int hops = 1;
+    while (forward ? limit < finish : limit > finish) {
+        position = forward ? nextInView(view, position) : previousInView(view, position);
+        int distance = viewDistance(view, position);
+        if (forward ? distance > limit : distance < limit) {
+            if (forward ? best < distance : best > distance) {
+                return -1;
+            }
+            hops++;
+            limit = best;
+        }
+        long long reach = (long long)distance + (forward ? 1 : -1) * viewAutonomy(view, position);
+        if (forward ? reach > best : reach < best) {
+            best = reach;
+        }
+    }
+    return hops;
+}
+
+// Whether text is what pianifica-percorso may answer on view
+static bool checkRoute(const networkView *view, int start, int finish, const char *text, size_t length) {
+    if (length == 16 && memcmp(text, "nessun percorso\n", 16) == 0) {
+        return minimumHops(view, start, finish) == -1;
+    }
+    int stops = 0;
+    long long previous = 0;
+    const char *p = text;
+    const char *end = text + length;
+    while (p < end) {
+        long long stop = 0;
+        const char *digits = p;
+        while (p < end && *p >= '0' && *p <= '9') {
+            stop = stop * 10 + (*p++ - '0');
+        }
+        if (p == digits || (p < end && *p != ' ' && *p != '\n')) {
+            return false;
+        }
+        p++;
+        if (stops == 0 ? stop != start : (findInView(view, (int)stop) == -1 || (start < finish) != (previous < stop))) {
+            return false;
+        }
+        if (stops > 0 && llabs(stop - previous) > viewAutonomy(view, findInView(view, (int)previous))) {
+            return false;
+        }
+        previous = stop;
+        stops++;
+    }
+    return previous == finish && stops - 1 == minimumHops(view, start, finish);
+}
+
+static void *runStressReader(void *argument) {
+    stressReader *reader = (stressReader *)argument;
+    viewScratch scratch = {0};
+    outputBuffer text;
+    initOutputWithCapacity(&text, -1, 256);
+    while (!__atomic_load_n(reader->stop, __ATOMIC_RELAXED)) {
+        const networkView *view = enterView(reader->views, reader->slot);
+        if ((reader->routes & 63) == 0 && !checkView(view)) {
+            reader->failures++;
+        }
+        if (view->count > 1) {
+            viewBlock *block = view->blocks[nextRandom(&reader->seed) % view->numBlocks];
+            int start = block->distances[nextRandom(&reader->seed) % block->count];
+            block = view->blocks[nextRandom(&reader->seed) % view->numBlocks];
+            int finish = block->distances[nextRandom(&reader->seed) % block->count];
+            if (start != finish) {
+                text.size = 0;
+                planOnView(view, start, finish, &scratch, &text);
+                if (!checkRoute(view, start, finish, text.data, text.size)) {
+                    reader->failures++;
+                }
+            }
+        }
+        reader->routes++;
+        leaveView(reader->views, reader->slot);
+    }
+    freeOutput(&text);
+    freeViewScratch(&scratch);
+    mergeThreadCounters();
+    return NULL;
+}
+
+// The published view holds exactly the stations of the tree
+static bool viewMatchesStations(stationIndex *index) {
+    const networkView *view = index->views->published;
+    if (!checkView(view)) {
+        return false;
+    }
+    int position = view->count > 0 ? 0 : -1;
+    for (station *node = firstStation(index); node != NULL; node = getSuccessor(node)) {
+        if (position == -1 || viewDistance(view, position) != node->distance ||
+            viewAutonomy(view, position) != node->maxAutonomy) {
+            return false;
+        }
+        position = nextInView(view, position);
+    }
+    return position == -1;
+}
+
+int stressViews(long long mutations, int numReaders) {
+    stationIndex index = {0};
+    index.views = createViewDomain();
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    int *distances = (int *)malloc((STRESS_STATIONS + mutations + 1) * sizeof(int));
+    int numDistances = 0;
+    int cars[4];
+    for (int i = 0; i < STRESS_STATIONS; i++) {
+        int distance = (int)(nextRandom(&seed) % STRESS_MAX_DISTANCE);
+        int numCars = 1 + (int)(nextRandom(&seed) % 4);
+        for (int j = 0; j < numCars; j++) {
+            cars[j] = (int)(nextRandom(&seed) % STRESS_MAX_AUTONOMY);
+        }
+        if (strcmp(addStation(&index, distance, numCars, cars), "aggiunta\n") == 0) {
+            distances[numDistances++] = distance;
+        }
+    }
+    publishView(&index);
+
+    bool stop = false;
+    stressReader *readers = (stressReader *)calloc(numReaders, sizeof(stressReader));
+    for (int i = 0; i < numReaders; i++) {
+        readers[i].views = index.views;
+        readers[i].slot = claimViewReader(index.views);
+        readers[i].stop = &stop;
+        readers[i].seed = 0x2545F4914F6CDD1DULL * (i + 1);
+        if (pthread_create(&readers[i].thread, NULL, runStressReader, &readers[i]) != 0) {
+            readers[i].slot = -2;
+        }
+    }
+
+    long long started = nowNanos();
+    long long failures = 0;
+    for (long long i = 1; i <= mutations; i++) {
+        uint64_t choice = nextRandom(&seed) % 100;
+        int targetIndex = numDistances ? (int)(nextRandom(&seed) % numDistances) : 0;
+        int target = numDistances ? distances[targetIndex] : 0;
+        if (choice < 35 || numDistances == 0) {
+            int distance = (int)(nextRandom(&seed) % STRESS_MAX_DISTANCE);
+            int numCars = 1 + (int)(nextRandom(&seed) % 4);
+            for (int j = 0; j < numCars; j++) {
+                cars[j] = (int)(nextRandom(&seed) % STRESS_MAX_AUTONOMY);
+            }
+            if (strcmp(addStation(&index, distance, numCars, cars), "aggiunta\n") == 0) {
+                distances[numDistances++] = distance;
+            }
+        } else if (choice < 50) {
+            demolishStation(&index, target);
+            distances[targetIndex] = distances[--numDistances];
+        } else if (choice < 80) {
+            addCar(&index, target, (int)(nextRandom(&seed) % STRESS_MAX_AUTONOMY));
+        } else {
+            // the best car goes, so the autonomy changes
+            removeCar(&index, target, findStation(&index, target)->maxAutonomy);
+        }
+        if (i % STRESS_PUBLISH_EVERY == 0) {
+            publishView(&index);
+        }
+        if (i % STRESS_CHECK_EVERY == 0) {
+            publishView(&index);
+            failures += !viewMatchesStations(&index);
+        }
+    }
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+    long long routes = 0;
+    for (int i = 0; i < numReaders; i++) {
+        if (readers[i].slot != -2) {
+            pthread_join(readers[i].thread, NULL);
+        }
+        releaseViewReader(index.views, readers[i].slot);
+        routes += readers[i].routes;
+        failures += readers[i].failures;
+    }
+    double seconds = (nowNanos() - started) / 1e9;
+    publishView(&index);
+    failures += !viewMatchesStations(&index);
+    reclaimViews(index.views);
+    failures += index.views->numRetired != 0;
+
+    fprintf(stderr, "stress: %lld mutations and %lld routes checked by %d readers in %.3f s, %lld failures\n", mutations,
+            routes, numReaders, seconds, failures);
+    printViewStats(index.views, stderr);
+    free(readers);
+    free(distances);
+    freeStationIndex(&index);
+    return failures ? 1 : 0;
+}
+
+// Microbenchmarks of the scan kernels, every set this CPU runs: the boundary
+// scans of the read index sweep over a sorted array of distances for runs of
+// a few stations up to a few hundred, and findCarEntry against the plain
+// binary lower bound for pools up to MAX_AUTO entries. Each set has to give
+// the answers of the first one.
+#define BENCH_DISTANCES (1 << 20)
+#define BENCH_SCANS (1 << 20)
+#define BENCH_SEARCHES (1 << 22)
+
+static int binaryCarSearch(const carList *carPool, int carAutonomy) {
+    int low = 0;
+    int high = carPool->numValues;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (carPool->cars[middle].autonomy < carAutonomy) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+int benchKernels(void) {
+    const scanKernels *sets[3];
+    int numSets = availableKernels(sets);
+    scanKernels selected = kernels;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    long long failures = 0;
+
+    // gaps of 1 to 15 km, 8 on average
+    int *distances = (int *)malloc(BENCH_DISTANCES * sizeof(int));
+    int *starts = (int *)malloc(BENCH_SCANS * sizeof(int));
+    distances[0] = 0;
+    for (int i = 1; i < BENCH_DISTANCES; i++) {
+        distances[i] = distances[i - 1] + 1 + (int)(nextRandom(&seed) % 15);
+    }
+    int runs[] = {4, 32, 256};
+    for (int r = 0; r < 3; r++) {
+        int reach = 8 * runs[r];
+        for (int i = 0; i < BENCH_SCANS; i++) {
+            starts[i] = 2 * runs[r] + (int)(nextRandom(&seed) % (BENCH_DISTANCES - 4 * runs[r]));
+        }
+        long long expected = 0;
+        for (int s = 0; s < numSets; s++) {
+            kernels = *sets[s];
+            long long checksum = 0;
+            long long started = nowNanos();
+            for (int i = 0; i < BENCH_SCANS; i++) {
+                int position = starts[i];
+                checksum += kernels.scanAbove(distances, position + 1, BENCH_DISTANCES, distances[position] + reach);
+                checksum -= kernels.scanBelow(distances, position - 1, 0, distances[position] - reach);
+            }
+            long long elapsed = nowNanos() - started;
+            if (s == 0) {
+                expected = checksum;
+            }
+            failures += checksum != expected;
+            fprintf(stderr, "boundary scan, runs of ~%3d stations: %-6s %7.2f ns per scan\n", runs[r], kernels.name,
+                    elapsed / (2.0 * BENCH_SCANS));
+        }
+    }
+    free(starts);
+    free(distances);
+
+    // pools of distinct autonomies 0 to 3 km apart, searched for any value
+    // from below the first to above the last
+    carList carPool = {0};
+    carPool.cars = (carEntry *)malloc(MAX_AUTO * sizeof(carEntry));
+    int *targets = (int *)malloc(BENCH_SEARCHES * sizeof(int));
+    int sizes[] = {4, 16, 64, MAX_AUTO};
+    for (int p = 0; p < 4; p++) {
+        carPool.numValues = carPool.numCars = (carCount)sizes[p];
+        for (int i = 0; i < sizes[p]; i++) {
+            carPool.cars[i].autonomy = (i ? carPool.cars[i - 1].autonomy : 0) + 1 + (int)(nextRandom(&seed) % 3);
+            carPool.cars[i].count = 1;
+        }
+        int span = carPool.cars[sizes[p] - 1].autonomy + 2;
+        for (int i = 0; i < BENCH_SEARCHES; i++) {
+            targets[i] = (int)(nextRandom(&seed) % span);
+        }
+        long long expected = 0;
+        long long started = nowNanos();
+        for (int i = 0; i < BENCH_SEARCHES; i++) {
+            expected += binaryCarSearch(&carPool, targets[i]);
+        }
+        fprintf(stderr, "car search, pools of %3d: binary %7.2f ns per search\n", sizes[p],
+                (double)(nowNanos() - started) / BENCH_SEARCHES);
+        for (int s = 0; s < numSets; s++) {
+            kernels = *sets[s];
+            long long checksum = 0;
+            started = nowNanos();
+            for (int i = 0; i < BENCH_SEARCHES; i++) {
+                checksum += findCarEntry(&carPool, targets[i]);
+            }
+            long long elapsed = nowNanos() - started;
+            failures += checksum != expected;
+            fprintf(stderr, "car search, pools of %3d: %-6s %7.2f ns per search\n", sizes[p], kernels.name,
+                    (double)elapsed / BENCH_SEARCHES);
+        }
+    }
+    free(targets);
+    free(carPool.cars);
+    kernels = selected;
+    fprintf(stderr, "kernels: %s selected, %lld mismatches\n", kernels.name, failures);
+    return failures ? 1 : 0;
+}
+#endif
+
+int main(int argc, char **argv) {
+    bool cacheStats = false;
+    bool routeStats = false;
+    bool tableStats = false;
+    const char *loadPath = NULL;
+    const char *savePath = NULL;
+    bool binaryInput = false;
+    bool encode = false;
+    bool decode = false;
+    bool pipeline = false;
+    bool stats = false;
+    bool concurrent = false;
+    bool viewStats = false;
+    bool memoryStats = false;
+    bool readIndexStats = false;
+#if DEV_TOOLS
+    bool kernelBench = false;
+#endif
+    const char *kernelsName = NULL;
+#if DEV_TOOLS
+    long long stressMutations = 0;
+#endif
+    const char *statsPath = NULL;
+    const char *servePath = NULL;
+#if DEV_TOOLS
+    const char *clientPath = NULL;
+    long numConnections = 1;
+    long depth = 64;
+#endif
+    long numThreads = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cache-stats") == 0) {
+            cacheStats = true;
+        } else if (strcmp(argv[i], "--route-stats") == 0) {
+            routeStats = true;
+        } else if (strcmp(argv[i], "--table-stats") == 0) {
+            tableStats = true;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            numThreads = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--binary") == 0) {
+            binaryInput = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats = true;
+        } else if (strcmp(argv[i], "--stats-file") == 0 && i + 1 < argc) {
+            stats = true;
+            statsPath = argv[++i];
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            pipeline = true;
+        } else if (strcmp(argv[i], "--concurrent") == 0) {
+            concurrent = true;
+        } else if (strcmp(argv[i], "--view-stats") == 0) {
+            viewStats = true;
+        } else if (strcmp(argv[i], "--memory-stats") == 0) {
+            memoryStats = true;
+        } else if (strcmp(argv[i], "--read-index-stats") == 0) {
+            readIndexStats = true;
+        } else if (strcmp(argv[i], "--kernels") == 0 && i + 1 < argc) {
+            kernelsName = argv[++i];
+#if DEV_TOOLS
+        } else if (strcmp(argv[i], "--bench-kernels") == 0) {
+            kernelBench = true;
+        } else if (strcmp(argv[i], "--stress") == 0 && i + 1 < argc) {
+            stressMutations = strtoll(argv[++i], NULL, 10);
+#endif
+        } else if (strcmp(argv[i], "--encode") == 0) {
+            encode = true;
+        } else if (strcmp(argv[i], "--decode") == 0) {
+            decode = true;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            servePath = argv[++i];
+#if DEV_TOOLS
+        } else if (strcmp(argv[i], "--client") == 0 && i + 1 < argc) {
+            clientPath = argv[++i];
+        } else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+            numConnections = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            depth = strtol(argv[++i], NULL, 10);
+#endif
+        } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            loadPath = argv[++i];
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            savePath = argv[++i];
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--cache-stats] [--route-stats] [--table-stats] [--threads n] [--load file] [--save file]\n"
+                    "          [--binary] [--pipeline] [--stats] [--stats-file file] [--serve socket]\n"
+                    "          [--concurrent] [--view-stats] [--memory-stats] [--read-index-stats]\n"
+                    "          [--kernels avx2|sse4|scalar]\n"
+                    "       %s --encode | --decode\n",
+                    argv[0], argv[0]);
+#if DEV_TOOLS
+            fprintf(stderr,
+                    "       %s --client socket [--connections n] [--depth n] [--binary]\n"
+                    "       %s --stress n [--threads n]\n"
+                    "       %s --bench-kernels\n",
+                    argv[0], argv[0], argv[0]);
+#endif
+            return 1;
+        }
+    }
+    if (!selectKernels(kernelsName)) {
+        fprintf(stderr, "kernels %s do not run on this machine\n", kernelsName);
+        return 1;
+    }
+#if DEV_TOOLS
+    if (kernelBench) {
+        return benchKernels();
+    }
+#endif
+    if (encode || decode) {
+        // text commands to binary records or back, stdin to stdout
+        inputReader in;
+        openInput(&in, STDIN_FILENO);
+        in.binary = decode;
+        outputBuffer out;
+        initOutput(&out, STDOUT_FILENO);
+        int status = convertCommands(&in, &out, encode);
+        closeInput(&in);
+        freeOutput(&out);
+        return status;
+    }
+#if DEV_TOOLS
+    if (clientPath) {
+        // replay the log on stdin against a --serve daemon
+        return runClient(clientPath, numConnections < 1 ? 1 : (int)numConnections, depth < 1 ? 1 : (int)depth,
+                         binaryInput);
+    }
+#endif
+#if COMMAND_STATS
+    statsEnabled = stats;
+#endif
+    if (numThreads < 1) {
+        numThreads = 1;
+    } else if (numThreads > MAX_QUERY_THREADS) {
+        numThreads = MAX_QUERY_THREADS;
+    }
+#if DEV_TOOLS
+    if (stressMutations > 0) {
+        return stressViews(stressMutations, (int)numThreads);
+    }
+#endif
+
+    stationIndex stations = {0};
+    plannerScratch scratch = {0};
+    if (loadPath) {
+        const char *problem = loadSnapshot(&stations, loadPath);
+        if (problem) {
+            fprintf(stderr, "cannot load snapshot %s: %s\n", loadPath, problem);
+            freeStationIndex(&stations);
+            return 1;
+        }
+    }
+#if PATH_CACHE_SIZE > 0
+    stations.cache = createPathCache();
+#endif
+    if (concurrent) {
+        // the views are made of the stations
+        buildLoadedStations(&stations);
+        stations.views = createViewDomain();
+    }
+    if (servePath) {
+        // the daemon takes the stop signals with sigwait, every thread
+        // including the batch workers has to leave them blocked
+        sigset_t signals;
+        stopSignals(&signals);
+        pthread_sigmask(SIG_BLOCK, &signals, NULL);
+        framedAnswers = true;
+    }
+    queryBatch batch;
+    initQueryBatch(&batch, &stations, (int)numThreads);
+    commandContext context = {0};
+    context.stations = &stations;
+    context.scratch = &scratch;
+    context.batch = &batch;
+    context.viewReader = stations.views && !servePath ? claimViewReader(stations.views) : -1;
+
+    int status = servePath ? serveCommands(&context, servePath, binaryInput)
+                           : runCommandLog(&context, binaryInput, pipeline);
+    // malformed input still gets its report and snapshot, the exit status
+    // stays the one of the input error
+    freeQueryBatch(&batch);
+    free(context.destinations);
+    freeViewScratch(&context.sweep);
+    if (stats) {
+        FILE *stream = statsPath ? fopen(statsPath, "w") : stderr;
+        if (stream) {
+            writeStats(stream);
+            if (stream != stderr) {
+                fclose(stream);
+            }
+        } else {
+            fprintf(stderr, "cannot write stats to %s\n", statsPath);
+            status = 1;
+        }
+    }
+    if (savePath || memoryStats) {
+        buildLoadedStations(&stations);
+    }
+    if (savePath && !saveSnapshot(&stations, savePath)) {
+        fprintf(stderr, "cannot write snapshot %s\n", savePath);
+        status = 1;
+    }
+#if PATH_CACHE_SIZE > 0
+    if (cacheStats) {
+        printPathCacheStats(stations.cache, stderr);
+    }
+#else
+    if (cacheStats) {
+        fprintf(stderr, "path cache: disabled\n");
+    }
+#endif
+    if (routeStats) {
+        printStandingRouteStats(stations.routes, stderr);
+    }
+    if (memoryStats) {
+        printMemoryStats(&stations, stderr);
+    }
+#if READ_INDEX && PATH_PLANNER == PLANNER_SWEEP
+    if (readIndexStats) {
+        printReadIndexStats(stations.sorted, stderr);
+    }
+#else
+    if (readIndexStats) {
+        fprintf(stderr, "read index: disabled\n");
+    }
+#endif
+    if (viewStats && stations.views) {
+        printViewStats(stations.views, stderr);
+    } else if (viewStats) {
+        fprintf(stderr, "views: disabled\n");
+    }
+#if STATION_TABLE
+    if (tableStats) {
+        printStationTableStats(&stations.table, stderr);
+    }
+#else
+    if (tableStats) {
+        fprintf(stderr, "station table: disabled\n");
+    }
+#endif
+    freeStationIndex(&stations);
+    freePlannerScratch(&scratch);
+
+    return status;
+}
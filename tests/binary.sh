@@ -0,0 +1,38 @@
+#!/bin/bash
+# binary.sh binary: the binary command format. A log converted with --encode
+# must get the answers of the text log with --binary, piped or not and with
+# --pipeline, and --decode must give the text log back. A log cut inside a
+# record is decoded as far as it goes with a "truncated ... command" error,
+# and its binary replay answers like the decoded text.
+. "$(dirname "$0")/common.sh"
+binary=$1
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+failures=0
+fail() {
+    echo "FAIL seed $seed: $1"
+    failures=$((failures + 1))
+}
+for seed in $(seq 1 "${ITERATIONS:-60}"); do
+    python3 "$tests/gen.py" "$seed" 1500 $((seed % 2 ? 200 : 5000)) 60 --extended > "$work/log"
+    "$binary" < "$work/log" > "$work/expected"
+    "$binary" --encode < "$work/log" > "$work/log.bin" || fail "--encode failed"
+    "$binary" --decode < "$work/log.bin" | cmp -s - "$work/log" || fail "--decode does not give the log back"
+    "$binary" --binary < "$work/log.bin" | cmp -s - "$work/expected" || fail "--binary answers differ"
+    cat "$work/log.bin" | "$binary" --binary | cmp -s - "$work/expected" || fail "--binary from a pipe answers differ"
+    "$binary" --binary --pipeline < "$work/log.bin" | cmp -s - "$work/expected" || fail "--binary --pipeline answers differ"
+
+    # cut inside the last record, never at its end
+    size=$(stat -c %s "$work/log.bin")
+    head -c $((size - 1 - seed % 3)) "$work/log.bin" > "$work/cut.bin"
+    "$binary" --decode < "$work/cut.bin" > "$work/cut" 2> "$work/error"
+    status=$?
+    if [ $status -ne 1 ] || ! grep -q '^truncated [a-z-]* command$' "$work/error"; then
+        fail "a cut record gives status $status and '$(cat "$work/error")'"
+    fi
+    "$binary" < "$work/cut" > "$work/cut.expected"
+    "$binary" --binary < "$work/cut.bin" | cmp -s - "$work/cut.expected" || fail "a cut binary log answers differently from its text"
+done
+echo "binary: $failures failures"
+[ $failures -eq 0 ]
@@ -0,0 +1,33 @@
+#!/bin/bash
+# cases.sh [binary] [args]: the 36 regression cases, six seeds of six network
+# shapes (small dense, medium, sparse, very sparse, crowded, large), each read
+# from a file and from a pipe and compared with base.
+. "$(dirname "$0")/common.sh"
+buildBase
+if [ $# -gt 0 ] && [ -x "$1" ]; then
+    binary=$1
+    shift
+else
+    build new
+    binary=$build/new
+fi
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+failures=0
+i=0
+for shape in "300 50 30" "2000 200 60" "3000 1000 300" "5000 100000 20000" "4000 30 10" "20000 5000 800"; do
+    for s in 1 2 3 4 5 6; do
+        python3 "$tests/gen.py" $((s * 31 + i)) $shape > "$work/c$i.in"
+        "$build/base" < "$work/c$i.in" > "$work/c$i.expected"
+        if ! "$binary" "$@" < "$work/c$i.in" | cmp -s - "$work/c$i.expected" ||
+            ! cat "$work/c$i.in" | "$binary" "$@" | cmp -s - "$work/c$i.expected"; then
+            cp "$work/c$i.in" "$build/failed-c$i.in"
+            echo "FAIL case $i, input kept in $build/failed-c$i.in"
+            failures=$((failures + 1))
+        fi
+        i=$((i + 1))
+    done
+done
+echo "cases${*:+ $*}: $failures failures"
+[ $failures -eq 0 ]
@@ -0,0 +1,22 @@
+# Sourced by the test scripts: paths and builds. Binaries go to tests/build,
+# base is 18.c as of the first commit (or $BASE_REF), the reference every
+# answer is compared with.
+tests=$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)
+repo=$(dirname "$tests")
+build=$tests/build
+mkdir -p "$build"
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--O2 -Wall -Wextra -Werror}
+
+# build name [flags]: compile the working tree's 18.c into $build/name
+build() {
+    local name=$1
+    shift
+    "$CC" $CFLAGS -pthread "$@" -o "$build/$name" "$repo/18.c" || exit 1
+}
+
+buildBase() {
+    [ -x "$build/base" ] && return
+    git -C "$repo" show "${BASE_REF:-$(git -C "$repo" rev-list --max-parents=0 HEAD)}:18.c" > "$build/base.c" || exit 1
+    "$CC" -O2 -o "$build/base" "$build/base.c" || exit 1
+}
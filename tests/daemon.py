@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+# daemon.py binary [args]: start binary --serve, pipeline a random log through
+# each of a few concurrent connections and check that every connection gets
+# the answers a plain run gives for its own log. The connections work on
+# disjoint stretches of the highway, so their answers do not depend on how
+# the daemon interleaves them. --serve ends direct paths with a newline the
+# plain output lacks, so answers are compared without newlines.
+import io, os, socket, subprocess, sys, tempfile, threading, time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from gen import gen
+
+CONNECTIONS = 4
+STRETCH = 1000000
+
+
+def shifted(seed, offset):
+    buf = io.StringIO()
+    gen(seed, 3000, 5000, 600, buf)
+    lines = []
+    for line in buf.getvalue().splitlines():
+        words = line.split()
+        # move every distance by offset, the autonomies stay
+        count = 2 if words[0] == 'pianifica-percorso' else 1
+        for i in range(1, 1 + count):
+            words[i] = str(int(words[i]) + offset)
+        lines.append(' '.join(words))
+    return ('\n'.join(lines) + '\n').encode()
+
+
+def converse(path, data, answers, index):
+    conn = socket.socket(socket.AF_UNIX)
+    conn.connect(path)
+
+    def write():
+        for i in range(0, len(data), 7919):
+            conn.sendall(data[i:i + 7919])
+        conn.shutdown(socket.SHUT_WR)
+
+    writer = threading.Thread(target=write)
+    writer.start()
+    got = []
+    while True:
+        chunk = conn.recv(1 << 16)
+        if not chunk:
+            break
+        got.append(chunk)
+    writer.join()
+    conn.close()
+    answers[index] = b''.join(got)
+
+
+def main():
+    binary, args = sys.argv[1], sys.argv[2:]
+    logs = [shifted(seed, seed * STRETCH) for seed in range(CONNECTIONS)]
+    expected = [subprocess.run([binary], input=log, capture_output=True, check=True).stdout for log in logs]
+    with tempfile.TemporaryDirectory() as work:
+        path = os.path.join(work, 'daemon.sock')
+        daemon = subprocess.Popen([binary, '--serve', path] + args)
+        for _ in range(200):
+            if os.path.exists(path):
+                break
+            time.sleep(0.05)
+        answers = [None] * CONNECTIONS
+        threads = [threading.Thread(target=converse, args=(path, logs[i], answers, i)) for i in range(CONNECTIONS)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        daemon.terminate()
+        daemon.wait()
+        left = os.path.exists(path)
+    failures = 0
+    for i in range(CONNECTIONS):
+        if answers[i].replace(b'\n', b'') != expected[i].replace(b'\n', b''):
+            print('connection %d: answers differ from a plain run' % i)
+            failures += 1
+    if daemon.returncode != 0 or left:
+        print('daemon exit status %d, socket %s' % (daemon.returncode, 'left behind' if left else 'removed'))
+        failures += 1
+    print('daemon%s: %d failures' % (''.join(' ' + a for a in args), failures))
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
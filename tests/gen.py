@@ -0,0 +1,83 @@
+# Random command logs: gen.py seed commands max-distance max-autonomy [--extended]
+# The original five commands only, with --extended the later ones too
+# (conta-tappe, pianifica-multiplo, registra-percorso), which reference.py answers through the original ones.
+import random, sys
+
+def gen(seed, n, maxd, maxa, out, extended=False):
+    r = random.Random(seed)
+    stations = set()
+    cars = {}
+    lines = []
+    def pick():
+        if stations and r.random() < 0.85:
+            return r.choice(tuple(stations)) if len(stations) < 2000 else r.choice(list(stations)[:2000])
+        return r.randint(0, maxd)
+    registered = []
+    def pickChanged():
+        # most car changes fall inside a registered route
+        if registered and r.random() < 0.8:
+            a, b = r.choice(registered)
+            inside = [d for d in stations if min(a, b) <= d <= max(a, b)]
+            if inside:
+                return r.choice(inside)
+        return pick()
+    for _ in range(n):
+        x = r.random()
+        if x < 0.25:
+            d = r.randint(0, maxd)
+            k = r.choice([0, 1, 2, 3, 5, 8]) if r.random() < 0.97 else r.randint(0, 40)
+            cs = [r.randint(0, maxa) for _ in range(k)]
+            lines.append("aggiungi-stazione %d %d%s" % (d, k, "".join(" %d" % c for c in cs)))
+            if d not in stations:
+                stations.add(d); cars[d] = cs
+        elif x < 0.40:
+            d = pickChanged(); a = r.randint(0, maxa)
+            if d in cars and r.random() < 0.3 and cars[d]:
+                a = r.choice(cars[d])
+            lines.append("aggiungi-auto %d %d" % (d, a))
+            if d in stations: cars[d].append(a)
+        elif x < 0.50:
+            d = pickChanged()
+            a = r.choice(cars[d]) if d in cars and cars[d] and r.random() < 0.7 else r.randint(0, maxa)
+            lines.append("rottama-auto %d %d" % (d, a))
+            if d in cars and a in cars[d]: cars[d].remove(a)
+        elif x < 0.55:
+            d = pick()
+            lines.append("demolisci-stazione %d" % d)
+            stations.discard(d); cars.pop(d, None)
+        else:
+            a = pick(); b = pick()
+            x = r.random() if extended else 1
+            if registered and x < 0.5 and r.random() < 0.7:
+                a, b = r.choice(registered)
+                x = 1
+            if x < 0.05:
+                lines.append("registra-percorso %d %d" % (a, b))
+                registered.append((a, b))
+            elif x < 0.2:
+                lines.append("conta-tappe %d %d" % (a, b))
+            elif x < 0.3:
+                # the start itself, repeats, missing stations and stations within direct reach
+                reach = max(cars.get(a, []), default=0)
+                near = [d for d in stations if abs(d - a) <= reach]
+                ds = []
+                for _ in range(r.choice([0, 1, 2, 4, 8])):
+                    y = r.random()
+                    if y < 0.1:
+                        ds.append(a)
+                    elif y < 0.25 and ds:
+                        ds.append(r.choice(ds))
+                    elif y < 0.35:
+                        ds.append(r.randint(0, maxd))
+                    elif y < 0.55 and near:
+                        ds.append(r.choice(near))
+                    else:
+                        ds.append(pick())
+                lines.append("pianifica-multiplo %d %d%s" % (a, len(ds), "".join(" %d" % d for d in ds)))
+            else:
+                lines.append("pianifica-percorso %d %d" % (a, b))
+    out.write("\n".join(lines) + "\n")
+
+if __name__ == "__main__":
+    seed, n, maxd, maxa = map(int, sys.argv[1:5])
+    gen(seed, n, maxd, maxa, sys.stdout, '--extended' in sys.argv[5:])
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# reference.py base < log: the answers the log must get, worked out by the
+# baseline build, which only knows the original five commands. The later
+# ones are translated into those:
+#   conta-tappe a b   pianifica-percorso a b, the hop count is the number of
+#                     stops of its route minus one, 0 when a == b
+#   pianifica-multiplo s n d1 .. dn
+#                     pianifica-percorso s d1 up to pianifica-percorso s dn,
+#                     their answers one after the other
+#   registra-percorso a b
+#                     left out: registrato the first time a -> b is
+#                     registered, non registrato after that, and every
+#                     pianifica-percorso answers as if it never ran
+# The baseline prints a route within direct reach without a newline, so its
+# output is split into answers by following the network: the answers of the
+# changes tell which of them took effect.
+import subprocess, sys
+
+
+def main():
+    base = sys.argv[1]
+    commands = [line.split() for line in sys.stdin.read().splitlines() if line.strip()]
+    translated = []
+    for words in commands:
+        if words[0] == 'conta-tappe':
+            translated.append('pianifica-percorso %s %s' % (words[1], words[2]))
+        elif words[0] == 'registra-percorso':
+            continue
+        elif words[0] == 'pianifica-multiplo':
+            translated.extend('pianifica-percorso %s %s' % (words[1], d) for d in words[3:3 + int(words[2])])
+        else:
+            translated.append(' '.join(words))
+    text = subprocess.run([base], input=('\n'.join(translated) + '\n').encode(), capture_output=True,
+                          check=True).stdout.decode()
+
+    cars = {}  # distance -> autonomies of the cars there
+    registered = set()
+    position = 0
+
+    def line():
+        nonlocal position
+        end = text.index('\n', position) + 1
+        answer = text[position:end]
+        position = end
+        return answer
+
+    def plan(start, finish):
+        nonlocal position
+        if start != finish and start in cars and finish in cars and abs(finish - start) <= max(cars[start], default=0):
+            answer = '%d %d' % (start, finish)
+            assert text.startswith(answer, position), (answer, text[position:position + 40])
+            position += len(answer)
+            return answer
+        return line()
+
+    out = []
+    for words in commands:
+        command, operands = words[0], [int(w) for w in words[1:]]
+        if command == 'aggiungi-stazione':
+            answer = line()
+            if answer == 'aggiunta\n':
+                cars[operands[0]] = operands[2:2 + operands[1]]
+        elif command == 'aggiungi-auto':
+            answer = line()
+            if answer == 'aggiunta\n':
+                cars[operands[0]].append(operands[1])
+        elif command == 'rottama-auto':
+            answer = line()
+            if answer == 'rottamata\n':
+                cars[operands[0]].remove(operands[1])
+        elif command == 'demolisci-stazione':
+            answer = line()
+            if answer == 'demolita\n':
+                del cars[operands[0]]
+        elif command == 'pianifica-percorso':
+            answer = plan(operands[0], operands[1])
+        elif command == 'conta-tappe':
+            route = plan(operands[0], operands[1])
+            if operands[0] == operands[1]:
+                answer = '0\n'
+            elif route == 'nessun percorso\n':
+                answer = route
+            else:
+                answer = '%d\n' % (len(route.split()) - 1)
+        elif command == 'pianifica-multiplo':
+            answer = ''.join(plan(operands[0], d) for d in operands[2:2 + operands[1]])
+        elif command == 'registra-percorso':
+            answer = 'non registrato\n' if tuple(operands) in registered else 'registrato\n'
+            registered.add(tuple(operands))
+        out.append(answer)
+    assert position == len(text), 'the baseline answered more than the log asked'
+    sys.stdout.write(''.join(out))
+
+
+if __name__ == '__main__':
+    main()
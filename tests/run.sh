@@ -0,0 +1,55 @@
+#!/bin/bash
+# run.sh: every check, stops at the first that fails
+. "$(dirname "$0")/common.sh"
+set -e
+build new
+build tools -DDEV_TOOLS=1
+
+"$tests/cases.sh" "$build/new"
+"$tests/differential.sh" "$build/new"
+"$tests/differential.sh" "$build/new" --pipeline
+"$tests/workloads.sh" "$build/new"
+python3 "$tests/snapshot.py" "$build/new"
+"$tests/binary.sh" "$build/new"
+
+# --serve: pipelined connections, then the --client load generator
+python3 "$tests/daemon.py" "$build/new"
+python3 "$tests/daemon.py" "$build/new" --threads 2
+socket=$(mktemp -u)
+"$build/new" --serve "$socket" &
+daemon=$!
+while [ ! -S "$socket" ]; do sleep 0.05; done
+python3 "$tests/gen.py" 7 20000 100000 2000 | "$build/tools" --client "$socket" --connections 4 --depth 16
+kill $daemon
+wait $daemon
+
+# --concurrent: the views checked under mutation, then the same answers as base
+"$build/tools" --stress 50000 --threads 4
+"$tests/differential.sh" "$build/new" --concurrent
+"$tests/differential.sh" "$build/new" --concurrent --threads 4
+python3 "$tests/daemon.py" "$build/new" --concurrent
+
+# scan kernels: every set this CPU runs and the build without them
+"$build/tools" --bench-kernels
+for kernels in avx2 sse4 scalar; do
+    if "$build/new" --kernels $kernels < /dev/null 2> /dev/null; then
+        "$tests/differential.sh" "$build/new" --kernels $kernels
+    fi
+done
+build scalar -DSIMD_KERNELS=0
+"$tests/differential.sh" "$build/scalar"
+
+# the other engines and layouts picked at build time, VARIANT_ITERATIONS logs each
+for variant in STATION_INDEX=INDEX_BPLUS PATH_PLANNER=PLANNER_DIJKSTRA PATH_PLANNER=PLANNER_FRONTIER \
+    COMPACT_STATIONS=1 STATION_TABLE=0 READ_INDEX=0 BULK_LOAD=0 USE_SLAB_ALLOCATOR=0 COMMAND_STATS=0; do
+    build variant -D$variant
+    echo "-D$variant"
+    "$tests/cases.sh" "$build/variant"
+    ITERATIONS=${VARIANT_ITERATIONS:-60} "$tests/differential.sh" "$build/variant"
+    python3 "$tests/snapshot.py" "$build/variant" 20
+    "$tests/workloads.sh" "$build/variant"
+done
+
+# the same checks on sanitizer builds
+"$tests/sanitize.sh"
+echo "all checks passed"
@@ -0,0 +1,46 @@
+#!/bin/bash
+# sanitize.sh: the checks again on AddressSanitizer/UndefinedBehaviorSanitizer
+# builds (default, B+-tree and malloc) and the threaded ones on a
+# ThreadSanitizer build. Each build is run through a wrapper that copies its
+# stderr to $build/sanitizer.log, any report there fails the check.
+# SANITIZE_ITERATIONS sets the number of random logs, 30 by default.
+. "$(dirname "$0")/common.sh"
+set -e
+export ITERATIONS=${SANITIZE_ITERATIONS:-30}
+export ASAN_OPTIONS=detect_leaks=0
+export UBSAN_OPTIONS=print_stacktrace=1
+log=$build/sanitizer.log
+: > "$log"
+
+# sanitized name cflags [flags]: build name.bin and the wrapper name
+sanitized() {
+    local name=$1 cflags=$2
+    shift 2
+    CFLAGS=$cflags build "$name.bin" "$@"
+    printf '#!/bin/bash\nexec "%s" "$@" 2> >(tee -a "%s" >&2)\n' "$build/$name.bin" "$log" > "$build/$name"
+    chmod +x "$build/$name"
+}
+asan="-O1 -g -fsanitize=address,undefined -fno-sanitize-recover=all"
+
+for variant in "" -DSTATION_INDEX=INDEX_BPLUS -DUSE_SLAB_ALLOCATOR=0; do
+    sanitized asan "$asan" -DDEV_TOOLS=1 $variant
+    echo "asan ${variant:-default}"
+    "$tests/cases.sh" "$build/asan"
+    "$tests/differential.sh" "$build/asan"
+    "$tests/differential.sh" "$build/asan" --pipeline
+    python3 "$tests/snapshot.py" "$build/asan" 20
+    "$tests/binary.sh" "$build/asan"
+done
+python3 "$tests/daemon.py" "$build/asan" --concurrent
+
+sanitized tsan "-O1 -g -fsanitize=thread" -DDEV_TOOLS=1
+"$build/tsan" --stress 20000 --threads 4
+"$tests/differential.sh" "$build/tsan" --threads 4
+"$tests/differential.sh" "$build/tsan" --concurrent --threads 4
+python3 "$tests/daemon.py" "$build/tsan" --threads 2
+python3 "$tests/daemon.py" "$build/tsan" --concurrent
+if grep -q 'Sanitizer\|runtime error' "$log"; then
+    echo "FAIL sanitizer reports in $log"
+    exit 1
+fi
+echo "sanitizers: no reports"
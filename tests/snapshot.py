@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+# snapshot.py binary [iterations]: --save then --load must answer like one run
+# over the whole log, and damaged snapshots must be rejected with status 1
+# for the reason checkSnapshot gives.
+import io, os, random, struct, subprocess, sys, tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from gen import gen
+
+
+def run(binary, args, data):
+    return subprocess.run([binary] + args, input=data, capture_output=True)
+
+
+def checksum(data):
+    # FNV-1a over the 64-bit words after the header, as snapshotChecksum
+    value = 0xcbf29ce484222325
+    for i in range(0, len(data) - len(data) % 8, 8):
+        value = ((value ^ struct.unpack_from('<Q', data, i)[0]) * 0x100000001b3) & (1 << 64) - 1
+    for byte in data[len(data) - len(data) % 8:]:
+        value = ((value ^ byte) * 0x100000001b3) & (1 << 64) - 1
+    return value
+
+
+HEADER = struct.Struct('<8sIIQQQQQQQ')
+
+
+def resealed(image, change):
+    # apply change to a copy of the image and make the checksum match again
+    image = bytearray(image)
+    change(image)
+    fields = list(HEADER.unpack_from(image))
+    fields[-1] = checksum(bytes(image[HEADER.size:]))
+    HEADER.pack_into(image, 0, *fields)
+    return bytes(image)
+
+
+def damaged(image):
+    fields = HEADER.unpack_from(image)
+    stations, distances = fields[3], fields[5]
+
+    def swap(image):
+        first, second = distances, distances + 4
+        image[first:first + 4], image[second:second + 4] = image[second:second + 4], image[first:first + 4]
+
+    def counts(image):
+        struct.pack_into('<Q', image, 16, 1 << 31)
+
+    def layout(image):
+        struct.pack_into('<Q', image, 16, stations + 1)
+
+    middle = bytearray(image)
+    middle[len(image) // 2] ^= 0x40
+    yield 'empty', 'cannot read', b''
+    yield 'truncated header', 'truncated header', image[:HEADER.size - 1]
+    yield 'truncated', 'bad layout', image[:-8]
+    yield 'not a snapshot', 'not a snapshot', b'X' + image[1:]
+    yield 'flipped byte', 'checksum mismatch', bytes(middle)
+    yield 'bad counts', 'bad counts', resealed(image, counts)
+    yield 'bad layout', 'bad layout', resealed(image, layout)
+    if stations >= 2:
+        yield 'swapped distances', 'distances out of order', resealed(image, swap)
+
+
+def main():
+    binary = sys.argv[1]
+    iterations = int(sys.argv[2]) if len(sys.argv) > 2 else 60
+    failures = 0
+    with tempfile.TemporaryDirectory() as work:
+        path = os.path.join(work, 'snapshot')
+        for seed in range(iterations):
+            r = random.Random(seed)
+            buf = io.StringIO()
+            gen(seed, r.choice([300, 1500]), r.choice([100, 2000]), r.choice([20, 200]), buf, extended=True)
+            lines = buf.getvalue().splitlines(True)
+            cut = r.randrange(1, len(lines))
+            rest = lines[cut:]
+            if seed % 3 == 1:
+                # only queries after the load, answered off the mapped arrays
+                rest = [line for line in rest if line.startswith('pianifica-percorso')]
+            elif seed % 3 == 2:
+                # a run of stations first, which must not be bulk loaded
+                rest = [line for line in rest if line.startswith('aggiungi-stazione')][:20] + rest
+            whole = run(binary, [], ''.join(lines[:cut] + rest).encode()).stdout
+            first = run(binary, ['--save', path], ''.join(lines[:cut]).encode()).stdout
+            second = run(binary, ['--load', path], ''.join(rest).encode()).stdout
+            if first + second != whole:
+                print('seed %d: --save and --load answer differently from one run' % seed)
+                failures += 1
+
+        # malformed input still leaves the snapshot of what came before it
+        answer = run(binary, ['--save', path], b'aggiungi-stazione 5 1 10\naggiungi-auto 5 x\n')
+        loaded = run(binary, ['--load', path], b'pianifica-percorso 5 5\naggiungi-stazione 5 0\n')
+        if answer.returncode != 1 or loaded.stdout != b'5\nnon aggiunta\n':
+            print('no snapshot after an input error')
+            failures += 1
+
+        run(binary, ['--save', path], ''.join(lines).encode())
+        image = open(path, 'rb').read()
+        for name, reason, data in damaged(image):
+            with open(path, 'wb') as file:
+                file.write(data)
+            result = run(binary, ['--load', path], b'pianifica-percorso 0 1\n')
+            if result.returncode != 1 or reason.encode() not in result.stderr or result.stdout:
+                print('%s snapshot: status %d, %r' % (name, result.returncode, result.stderr))
+                failures += 1
+    print('snapshot: %d failures' % failures)
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
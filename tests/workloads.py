@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+# workloads.py dir [stations]: the large logs behind the timing notes, written
+# into dir. stations.in builds a highway of 200000 stations by default,
+# ops.in follows with as many queries and car changes on nearby stations.
+# burst.in, alt.in and alt8.in run after ops.in's network (or a snapshot of
+# it) and add stations at odd distances up to 2^31 - 1, ask ops.in's queries
+# and demolish half of what they added: 10 rounds of 2000 stations and 20000
+# queries, 100000 rounds of one station and one query, and 20000 rounds of one
+# station and eight queries.
+import os, random, sys
+
+
+def network(stations, directory):
+    r = random.Random(7)
+    ds = r.sample(range(0, 50000000), stations)
+    with open(os.path.join(directory, 'stations.in'), 'w') as f:
+        for d in ds:
+            k = r.choice([1, 2, 3, 5])
+            f.write("aggiungi-stazione %d %d %s\n" % (d, k, " ".join(str(r.randint(100, 2000)) for _ in range(k))))
+    r = random.Random(7)
+    s = sorted(ds)
+    with open(os.path.join(directory, 'ops.in'), 'w') as f:
+        for _ in range(stations):
+            x = r.random()
+            if x < 0.8:
+                j = r.randrange(len(s))
+                k = min(max(j + r.choice([-1, 1]) * r.randint(1, 40), 0), len(s) - 1)
+                f.write("pianifica-percorso %d %d\n" % (s[j], s[k]))
+            elif x < 0.9:
+                f.write("aggiungi-auto %d %d\n" % (r.choice(ds), r.randint(100, 2000)))
+            else:
+                f.write("rottama-auto %d %d\n" % (r.choice(ds), r.randint(100, 2000)))
+
+
+def bursts(directory):
+    r = random.Random(24)
+    qs = [l for l in open(os.path.join(directory, 'ops.in')) if l.startswith('pianifica')]
+
+    def burst(changes, queries, rounds, name):
+        out = []
+        qi = 0
+        for _ in range(rounds):
+            added = []
+            for _ in range(changes):
+                d = r.randint(0, 2**30) * 2 + 1
+                out.append("aggiungi-stazione %d 2 %d %d\n" % (d, r.randint(0, 50000), r.randint(0, 50000)))
+                added.append(d)
+            for _ in range(queries):
+                out.append(qs[qi % len(qs)])
+                qi += 1
+            for d in added[:changes // 2]:
+                out.append("demolisci-stazione %d\n" % d)
+        with open(os.path.join(directory, name), 'w') as f:
+            f.write("".join(out))
+
+    burst(2000, 20000, 10, 'burst.in')
+    burst(1, 1, 100000, 'alt.in')
+    burst(1, 8, 20000, 'alt8.in')
+
+
+if __name__ == '__main__':
+    network(int(sys.argv[2]) if len(sys.argv) > 2 else 200000, sys.argv[1])
+    bursts(sys.argv[1])
@@ -0,0 +1,44 @@
+#!/bin/bash
+# workloads.sh [binary] [args]: the logs of workloads.py. On a highway of
+# WORKLOAD_BASE_STATIONS stations (5000 by default) the answers to the first
+# WORKLOAD_BASE_LINES lines of each log (50000 by default, base is slow on
+# the bursts) must equal base's. On the full highway of WORKLOAD_STATIONS
+# (200000 by default), too large for base, --load of a snapshot of
+# stations.in followed by ops.in, burst.in or alt8.in must answer like one
+# run of stations.in and that log.
+. "$(dirname "$0")/common.sh"
+buildBase
+if [ $# -gt 0 ] && [ -x "$1" ]; then
+    binary=$1
+    shift
+else
+    build new
+    binary=$build/new
+fi
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+failures=0
+fail() {
+    echo "FAIL $1"
+    failures=$((failures + 1))
+}
+
+mkdir "$work/small" "$work/full"
+python3 "$tests/workloads.py" "$work/small" "${WORKLOAD_BASE_STATIONS:-5000}"
+for log in ops burst alt8; do
+    cat "$work/small/stations.in" > "$work/whole"
+    head -n "${WORKLOAD_BASE_LINES:-50000}" "$work/small/$log.in" >> "$work/whole"
+    "$build/base" < "$work/whole" > "$work/expected"
+    "$binary" "$@" < "$work/whole" | cmp -s - "$work/expected" || fail "$log against base"
+done
+
+python3 "$tests/workloads.py" "$work/full" "${WORKLOAD_STATIONS:-200000}"
+stations=$(wc -l < "$work/full/stations.in")
+"$binary" "$@" --save "$work/snapshot" < "$work/full/stations.in" > /dev/null || fail "--save"
+for log in ops burst alt8; do
+    cat "$work/full/stations.in" "$work/full/$log.in" | "$binary" "$@" | tail -n +$((stations + 1)) > "$work/expected"
+    "$binary" "$@" --load "$work/snapshot" < "$work/full/$log.in" | cmp -s - "$work/expected" || fail "$log after --load"
+done
+echo "workloads${*:+ $*}: $failures failures"
+[ $failures -eq 0 ]